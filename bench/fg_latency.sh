@@ -0,0 +1,27 @@
+#!/bin/bash
+
+# Mesure le surcout par commande au premier plan : on fait executer N fois "true"
+# a notre shell et a /bin/sh, puis on affiche le temps moyen en microsecondes.
+# Usage : bench/fg_latency.sh [N] [commande]   (par exemple "sleep 0.01" pour une commande qui dure)
+
+N=${1:-1000}
+CMD=${2:-/bin/true}
+SCRIPT=$(mktemp)
+trap 'rm -f $SCRIPT' EXIT
+
+for i in $(seq $N)
+do
+    echo $CMD >> $SCRIPT
+done
+
+# bench <shell> - Affiche le temps moyen par commande pour <shell>
+bench() {
+    local start end
+    start=$(date +%s%N)
+    $1 < $SCRIPT > /dev/null
+    end=$(date +%s%N)
+    printf "%-10s %8d commands  %8d us/command\n" $1 $N $(( (end - start) / 1000 / N ))
+}
+
+bench /bin/sh
+bench ./shell
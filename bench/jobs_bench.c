@@ -0,0 +1,89 @@
+/* jobs_bench - Microbenchmark of the job table : adds N jobs, reaps all their processes in random order, then
+ *              notifies and frees them with printjobs(). Finally runs N foreground jobs one after the other.
+ * Usage : ./jobs_bench [N]   (100000 by default)
+ * No process is created, the pids are made up
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "jobs.h"
+
+#define PIDS_PER_JOB 4
+
+/* now - Get a monotonic timestamp
+ * Arguments : None
+ * Return value : The timestamp in nanoseconds
+ */
+static long long now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* report - Print the duration of a phase of the benchmark
+ * Arguments :
+ *  - phase - The name of the phase
+ *  - start - The timestamp of the start of the phase
+ *  - nb_ops - The number of operations done during the phase
+ * Return value : None
+ */
+static void report(char *phase, long long start, long nb_ops) {
+    long long elapsed = now() - start;
+    fprintf(stderr, "%-12s %8ld ops  %10.3f ms  %8.1f ns/op\n", phase, nb_ops, elapsed / 1e6,
+            (double) elapsed / nb_ops);
+}
+
+int main(int argc, char *argv[]) {
+    long n = (argc > 1) ? atol(argv[1]) : 100000;
+    long nb_pids = n * PIDS_PER_JOB;
+    pid_t *pids = (pid_t *) malloc(sizeof(pid_t) * nb_pids);
+    long long start;
+
+    for (long i = 0; i < nb_pids; i++)
+        pids[i] = (pid_t) (i + 2);
+
+    initjobs();
+
+    start = now();
+    for (long i = 0; i < n; i++)
+        addjob("sleep 1 | cat | cat | cat &", pids + i * PIDS_PER_JOB, PIDS_PER_JOB);
+    report("addjob", start, n);
+
+    start = now();
+    for (long i = 0; i < nb_pids; i++)
+        getjob(pids[i]);
+    report("getjob", start, nb_pids);
+
+    // Reap the processes in a random order, like SIGCHLDs of concurrent background jobs would
+    srand(42);
+    for (long i = nb_pids - 1; i > 0; i--) {
+        long j = rand() % (i + 1);
+        pid_t tmp = pids[i];
+        pids[i] = pids[j];
+        pids[j] = tmp;
+    }
+    start = now();
+    for (long i = 0; i < nb_pids; i++)
+        deletejobpid(pids[i], 0, NULL);
+    report("deletejobpid", start, nb_pids);
+
+    // Notification of the Done jobs, this frees them
+    freopen("/dev/null", "w", stdout);
+    start = now();
+    printjobs(0);
+    report("printjobs", start, n);
+
+    // Foreground jobs are freed as soon as their last process is reaped, their blocks are reused right away
+    start = now();
+    for (long i = 0; i < n; i++) {
+        setfg(addjob("sleep 1 | cat | cat | cat", pids, PIDS_PER_JOB));
+        for (int j = 0; j < PIDS_PER_JOB; j++)
+            deletejobpid(pids[j], 0, NULL);
+    }
+    report("fg cycle", start, n);
+
+    freejobs();
+    free(pids);
+    return 0;
+}
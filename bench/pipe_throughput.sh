@@ -0,0 +1,33 @@
+#!/bin/bash
+
+# Mesure le debit d'un pipeline de 4 commandes : notre shell fait passer un fichier de SIZE Mo dans
+# "cat | /bin/cat | /bin/cat | wc -c", puis avec le builtin cat, puis avec le builtin relay au milieu (les builtins
+# deplacent les donnees avec sendfile() et splice() sans les copier), avec les tubes par defaut puis avec
+# "setopt pipesize=1M".
+# Usage : bench/pipe_throughput.sh [SIZE]   (SIZE en Mo, 1024 par defaut)
+
+SIZE=${1:-1024}
+DATA=$(mktemp)
+SCRIPT=$(mktemp)
+trap 'rm -f $DATA $SCRIPT' EXIT
+
+head -c $(( SIZE * 1048576 )) /dev/zero > $DATA
+
+# bench <pipesize> <stage> - Affiche le debit du pipeline dont les 2 etapes du milieu sont <stage>
+bench() {
+    local start end
+    echo "setopt pipesize=$1" > $SCRIPT
+    echo "cat $DATA | $2 | $2 | wc -c" >> $SCRIPT
+    start=$(date +%s%N)
+    ./shell < $SCRIPT > /dev/null
+    end=$(date +%s%N)
+    printf "pipesize=%-3s %-8s %6d MB  %8d ms  %6d MB/s\n" $1 $2 $SIZE $(( (end - start) / 1000000 )) \
+        $(( SIZE * 1048576 * 1000 / (end - start) ))
+}
+
+for size in 0 1M
+do
+    bench $size /bin/cat
+    bench $size cat
+    bench $size relay
+done
@@ -0,0 +1,34 @@
+#!/bin/bash
+
+# Mesure la latence du prompt en mode interactif : notre shell tourne dans un pseudo-terminal,
+# on lui envoie N lignes vides et on attend a chaque fois le prompt suivant.
+# On affiche le temps moyen entre l'envoi d'une ligne et la reception du prompt, en microsecondes.
+# Usage : bench/prompt_latency.sh [N] [shell]
+
+N=${1:-2000}
+SHELL_BIN=${2:-./shell}
+
+python3 - "$N" "$SHELL_BIN" <<'PYTHON'
+import os, pty, sys, time
+
+n, shell = int(sys.argv[1]), sys.argv[2]
+pid, fd = pty.fork()
+if pid == 0:
+    os.execv(shell, [shell])
+
+# wait_prompt - Lit la sortie du shell jusqu'a la fin d'un prompt
+def wait_prompt():
+    out = b""
+    while not out.endswith(b"$ "):
+        out += os.read(fd, 4096)
+
+wait_prompt()
+start = time.perf_counter_ns()
+for i in range(n):
+    os.write(fd, b"\n")
+    wait_prompt()
+end = time.perf_counter_ns()
+os.write(fd, b"exit\n")
+os.waitpid(pid, 0)
+print("%-10s %8d prompts  %8d us/prompt" % (shell, n, (end - start) // 1000 // n))
+PYTHON
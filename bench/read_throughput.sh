@@ -0,0 +1,42 @@
+#!/bin/bash
+
+# Mesure le debit de lecture des scripts : notre shell lit un script de SIZE Mo fait de lignes courtes
+# (des commentaires, donc aucun processus cree), puis un script fait de lignes de 64 Ko.
+# Chaque script est lu sur l'entree standard, puis passe en argument (mode script, projete en memoire).
+# Usage : bench/read_throughput.sh [SIZE] [shell]   (SIZE en Mo, 64 par defaut)
+
+SIZE=${1:-64}
+SHELL_BIN=${2:-./shell}
+SCRIPT=$(mktemp)
+trap 'rm -f $SCRIPT' EXIT
+
+# run <nom> <commande...> - Affiche le debit de lecture du script courant par la commande
+run() {
+    local name=$1 start end bytes
+    shift
+    bytes=$(stat -c %s $SCRIPT)
+    start=$(date +%s%N)
+    "$@" > /dev/null
+    end=$(date +%s%N)
+    printf "%-14s %6d MB  %8d ms  %6d MB/s\n" $name $(( bytes / 1000000 )) $(( (end - start) / 1000000 )) \
+        $(( bytes * 1000 / (end - start) ))
+}
+
+# bench <nom> - Mesure les deux modes de lecture du script courant
+bench() {
+    run $1-stdin sh -c "$SHELL_BIN < $SCRIPT"
+    run $1-script $SHELL_BIN $SCRIPT
+}
+
+# Lignes courtes
+yes "# echo short line" | head -c $(( SIZE * 1000000 )) > $SCRIPT
+bench short
+
+# Lignes longues
+head -c 65535 /dev/zero | tr '\0' 'x' | sed 's/^/# /' > $SCRIPT.line
+for i in $(seq $(( SIZE * 1000000 / 65538 )))
+do
+    cat $SCRIPT.line
+done > $SCRIPT
+rm -f $SCRIPT.line
+bench long
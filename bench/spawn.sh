@@ -0,0 +1,27 @@
+#!/bin/bash
+
+# Compare le debit de lancement des commandes externes avec fork() et avec posix_spawn() :
+# on fait executer N pipelines de 4 commandes a notre shell, avec "setopt spawn=0" puis "setopt spawn=1".
+# Usage : bench/spawn.sh [N]
+
+N=${1:-500}
+SCRIPT=$(mktemp)
+trap 'rm -f $SCRIPT' EXIT
+
+# bench <spawn> - Affiche le nombre de pipelines lances par seconde avec l'option spawn=<spawn>
+bench() {
+    local start end
+    echo setopt spawn=$1 > $SCRIPT
+    for i in $(seq $N)
+    do
+        echo "/bin/true | /bin/true | /bin/true | /bin/true" >> $SCRIPT
+    done
+    start=$(date +%s%N)
+    ./shell < $SCRIPT > /dev/null
+    end=$(date +%s%N)
+    printf "spawn=%d  %6d pipelines  %8d us/pipeline  %6d pipelines/s\n" $1 $N $(( (end - start) / 1000 / N )) \
+        $(( N * 1000000000 / (end - start) ))
+}
+
+bench 0
+bench 1
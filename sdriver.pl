@@ -42,7 +42,7 @@ use IPC::Open2;
 sub usage 
 {
     printf STDERR "$_[0]\n";
-    printf STDERR "Usage: $0 [-hv] -t <trace> -s <shellprog> -a <args>\n";
+    printf STDERR "Usage: $0 [-hvx] -t <trace> -s <shellprog> -a <args>\n";
     printf STDERR "Options:\n";
     printf STDERR "  -h            Print this message\n";
     printf STDERR "  -v            Be more verbose\n";
@@ -50,11 +50,12 @@ sub usage
     printf STDERR "  -s <shell>    Shell program to test\n";
     printf STDERR "  -a <args>     Shell arguments\n";
     printf STDERR "  -g            Generate output for autograder\n";
+    printf STDERR "  -x            Print the exit status of the shell\n";
     die "\n" ;
 }
 
 # Parse the command line arguments
-getopts('hgvt:s:a:');
+getopts('hgvxt:s:a:');
 if ($opt_h) {
     usage();
 }
@@ -69,6 +70,7 @@ $infile = $opt_t;
 $shellprog = $opt_s;
 $shellargs = $opt_a;
 $grade = $opt_g;
+$exitstatus = $opt_x;
 
 # Make sure the input script exists and is readable
 -e $infile
@@ -166,6 +168,7 @@ while (<INFILE>) {
 	    print "$0: Waiting for child $pid\n";
 	}
 	wait;
+	$status = $?;
 	if ($verbose) {
 	    print "$0: Child $pid reaped\n";
 	}
@@ -201,7 +204,14 @@ while ($line = <Reader>) {
 close Reader;
 
 # Finally, parent reaps child
-wait;
+if (wait == $pid) {
+    $status = $?;
+}
+
+# Like the shells, a shell killed by a signal exits with 128 + the signal
+if ($exitstatus) {
+    printf("exit status %d\n", ($status & 127) ? 128 + ($status & 127) : $status >> 8);
+}
 
 if ($verbose) {
     print "$0: Shell terminated\n";
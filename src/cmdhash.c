@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "cmdhash.h"
+
+#define INIT_BUCKETS 64  // Initial number of buckets, always a power of 2
+
+// Element of the chained lists of the table
+typedef struct _hashentry {
+    struct _hashentry *next;
+    char *name;  // Name of the command
+    char *path;  // Absolute path of the executable
+    int hits;    // Number of times the path was used
+} HashEntry;
+
+static HashEntry **buckets = NULL;  // Global variable : the table
+static size_t nb_buckets = 0;       // Number of buckets in the table
+static size_t nb_entries = 0;       // Number of commands remembered
+static char *hashpath = NULL;       // Value of $PATH when the remembered paths were found
+static char *relpath = NULL;        // Last path found through a relative entry of $PATH, never remembered
+
+/* hashname - Hash a command name (FNV-1a)
+ * Arguments :
+ *  - name - The name of the command
+ * Return value : The hash of the name
+ */
+static size_t hashname(char *name) {
+    size_t h = 14695981039346656037UL;
+    for (; *name; name++)
+        h = (h ^ (unsigned char) *name) * 1099511628211UL;
+    return h;
+}
+
+/* findentry - Find the entry of a command in the table
+ * Arguments :
+ *  - name - The name of the command
+ * Return value : A pointer to the link pointing to the entry (or to the end of its bucket if not found)
+ */
+static HashEntry **findentry(char *name) {
+    HashEntry **link = &buckets[hashname(name) & (nb_buckets - 1)];
+    while (*link != NULL && strcmp((*link)->name, name) != 0)
+        link = &(*link)->next;
+    return link;
+}
+
+/* growtable - Double the number of buckets, or create the table if it does not exist
+ * Arguments : None
+ * Return value : None
+ */
+static void growtable() {
+    size_t old_nb = nb_buckets;
+    HashEntry **old = buckets;
+
+    nb_buckets = (old_nb == 0) ? INIT_BUCKETS : old_nb * 2;
+    buckets = (HashEntry **) calloc(nb_buckets, sizeof(HashEntry *));
+    for (size_t i = 0; i < old_nb; i++) {
+        HashEntry *e = old[i];
+        while (e != NULL) {
+            HashEntry *next = e->next;
+            HashEntry **link = &buckets[hashname(e->name) & (nb_buckets - 1)];
+            e->next = *link;
+            *link = e;
+            e = next;
+        }
+    }
+    free(old);
+}
+
+/* searchpath - Walk $PATH to find the executable of a command
+ * Arguments :
+ *  - name - The name of the command
+ *  - path - The value of $PATH
+ * Return value : The path of the executable (to be freed)
+ *                NULL if not found
+ */
+static char *searchpath(char *name, char *path) {
+    size_t name_len = strlen(name);
+    struct stat st;
+
+    while (1) {
+        char *end = strchr(path, ':');
+        if (end == NULL)
+            end = path + strlen(path);
+        size_t dir_len = end - path;
+        char *file = (char *) malloc(dir_len + name_len + 3);
+
+        // An empty entry of $PATH designates the current directory
+        if (dir_len == 0)
+            strcpy(file, "./");
+        else {
+            memcpy(file, path, dir_len);
+            file[dir_len] = '/';
+            file[dir_len + 1] = 0;
+        }
+        strcat(file, name);
+
+        if (stat(file, &st) == 0 && S_ISREG(st.st_mode) && access(file, X_OK) == 0)
+            return file;
+        free(file);
+
+        if (*end == 0)
+            return NULL;
+        path = end + 1;
+    }
+}
+
+char *hashlookup(char *name) {
+    char *path = getenv("PATH");
+    if (path == NULL)
+        path = "/bin:/usr/bin";  // Same default as execvp()
+
+    // Paths are not searched for
+    if (strchr(name, '/') != NULL)
+        return name;
+
+    // Everything remembered is wrong as soon as $PATH changes
+    if (hashpath == NULL || strcmp(hashpath, path) != 0) {
+        hashclear();
+        hashpath = strdup(path);
+    }
+
+    if (nb_buckets == 0)
+        growtable();
+
+    HashEntry **link = findentry(name);
+    if (*link == NULL) {
+        char *file = searchpath(name, path);
+        if (file == NULL)
+            return NULL;
+
+        // Relative paths depend on the current directory, they cannot be remembered
+        if (file[0] != '/') {
+            free(relpath);
+            return relpath = file;
+        }
+
+        if (nb_entries >= nb_buckets) {
+            growtable();
+            link = findentry(name);
+        }
+        HashEntry *e = (HashEntry *) malloc(sizeof(HashEntry));
+        e->next = NULL;
+        e->name = strdup(name);
+        e->path = file;
+        e->hits = 0;
+        *link = e;
+        nb_entries++;
+    }
+
+    (*link)->hits++;
+    return (*link)->path;
+}
+
+void hashforget(char *name) {
+    if (nb_buckets == 0)
+        return;
+
+    HashEntry **link = findentry(name);
+    HashEntry *e = *link;
+    if (e == NULL)
+        return;
+    *link = e->next;
+    free(e->name);
+    free(e->path);
+    free(e);
+    nb_entries--;
+}
+
+void hashclear() {
+    for (size_t i = 0; i < nb_buckets; i++) {
+        HashEntry *e = buckets[i];
+        while (e != NULL) {
+            HashEntry *next = e->next;
+            free(e->name);
+            free(e->path);
+            free(e);
+            e = next;
+        }
+    }
+    free(buckets);
+    free(hashpath);
+    free(relpath);
+    buckets = NULL;
+    hashpath = NULL;
+    relpath = NULL;
+    nb_buckets = 0;
+    nb_entries = 0;
+}
+
+void printhash() {
+    if (nb_entries == 0) {
+        printf("hash: hash table empty\n");
+        return;
+    }
+
+    printf("hits\tcommand\n");
+    for (size_t i = 0; i < nb_buckets; i++)
+        for (HashEntry *e = buckets[i]; e != NULL; e = e->next)
+            printf("%4d\t%s\n", e->hits, e->path);
+}
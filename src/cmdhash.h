@@ -0,0 +1,35 @@
+#ifndef TP_SHELL_SR_2023_CMDHASH_H
+#define TP_SHELL_SR_2023_CMDHASH_H
+
+/* Hash table remembering the absolute path of the external commands, like the "hash" builtin of bash, so $PATH is
+ * only walked the first time a command is used. The whole table is forgotten as soon as $PATH changes.
+ */
+
+/* hashlookup - Get the absolute path of a command, walking $PATH and remembering the result if not already known
+ * Arguments :
+ *  - name - The name of the command
+ * Return value : The path of the executable, owned by the table (or name itself if it contains a '/')
+ *                NULL if no executable was found in $PATH
+ */
+char *hashlookup(char *name);
+
+/* hashforget - Forget the path of a command, to be used when the remembered executable disappeared
+ * Arguments :
+ *  - name - The name of the command
+ * Return value : None
+ */
+void hashforget(char *name);
+
+/* hashclear - Forget every remembered path (like "hash -r")
+ * Arguments : None
+ * Return value : None
+ */
+void hashclear(void);
+
+/* printhash - Print the remembered commands with their number of hits (like "hash")
+ * Arguments : None
+ * Return value : None
+ */
+void printhash(void);
+
+#endif //TP_SHELL_SR_2023_CMDHASH_H
@@ -0,0 +1,209 @@
+#include <sys/signalfd.h>
+#include <sys/epoll.h>
+#include <poll.h>
+#include <stdio.h>
+#include <sys/syscall.h>
+#include "events.h"
+#include "jobs.h"
+#include "stats.h"
+#include "readcmd.h"
+#include "csapp.h"
+
+#define NB_SIGINFO 16  // Number of signals read from the signalfd at once
+
+static int sfd;               // signalfd receiving SIGCHLD, SIGINT and SIGTSTP
+static int epfd;              // epoll instance watching sfd, and standard input if it is not a regular file
+static int stdin_polled = 0;  // 1 if standard input is watched by epfd
+static int evprint = 1;       // 1 if job notifications should be printed
+static pid_t helper = -1;     // Child of the shell that is not part of a job, waited by waitchild(), -1 if none
+static int helper_status;     // Wait status of the helper once it terminated
+
+/* handle_int - Handle a SIGINT
+ * Arguments : None
+ * Return value : None
+ */
+static void handle_int() {
+    // A helper is a command of the foreground command line as well
+    if (helper > 0)
+        kill(helper, SIGINT);
+
+    // If there is a foreground job, terminate it
+    int fg = getfg();
+    if (fg != -1)
+        termjob(fg);
+}
+
+/* handle_tstp - Handle a SIGTSTP
+ * Arguments : None
+ * Return value : None
+ */
+static void handle_tstp() {
+    // If there is a foreground job, stop it
+    int fg = getfg();
+    if (fg == -1)
+        return;
+
+    // Use return value of stopjob() to check for errors
+    switch (stopjob(fg)) {
+        case 2:
+            fprintf(stderr, "stop: Job already stopped\n");
+            break;
+        case 1:
+            fprintf(stderr, "stop: No such job\n");
+            break;
+        case 0:  // Everything went well
+        default:
+            if (evprint)
+                printf("\n[%d] %d  Suspended  %s\n", fg, getjobpgid(fg), getjobcmd(fg));
+            break;
+    }
+}
+
+/* handle_child - Handle the SIGCHLDs, the signalfd merges them so every child that changed state is collected
+ * Arguments : None
+ * Return value : None
+ */
+static void handle_child() {
+    int status;
+    pid_t pid;
+    struct rusage usage;
+    int count = 0;
+    // Reaping all terminated children, but managing Stopped and Continued children as well
+    // wait4() gives the resources used by the terminated children, which are accounted to their job
+    while ((pid = wait4(-1, &status, WNOHANG | WUNTRACED | WCONTINUED, &usage)) > 0) {
+        if (pid == helper) {
+            if (WIFEXITED(status) || WIFSIGNALED(status)) {
+                helper_status = status;
+                helper = -1;
+            }
+        } else if (WIFSTOPPED(status))
+            stopjobpid(pid);            // If the child was stopped, put the job in "Stopped" status
+        else if (WIFCONTINUED(status))
+            contjobpid(pid);            // If the child was continued, put the job in "Running" status
+        else
+            deletejobpid(pid, status, &usage);  // Delete the child from the job list
+        count++;
+    }
+    statsrecord(ST_CHILD, count);
+}
+
+void initevents(int print) {
+    sigset_t mask;
+    struct epoll_event ev;
+
+    evprint = print;
+
+    // The signals must be blocked to be read from the signalfd, children unblock them before execvp()
+    Sigemptyset(&mask);
+    Sigaddset(&mask, SIGCHLD);
+    Sigaddset(&mask, SIGINT);
+    Sigaddset(&mask, SIGTSTP);
+    Sigprocmask(SIG_BLOCK, &mask, NULL);
+
+    if ((sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) < 0)
+        unix_error("Signalfd error");
+    if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+        unix_error("Epoll_create error");
+
+    ev.events = EPOLLIN;
+    ev.data.fd = sfd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, sfd, &ev) < 0)
+        unix_error("Epoll_ctl error");
+
+    // Regular files cannot be watched (EPERM), they are always readable anyway
+    ev.data.fd = 0;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, 0, &ev) == 0)
+        stdin_polled = 1;
+}
+
+int dispatchevents() {
+    struct signalfd_siginfo info[NB_SIGINFO];
+    ssize_t n;
+    int count = 0, child = 0;
+
+    while ((n = read(sfd, info, sizeof(info))) > 0) {
+        for (int i = 0; i < n / sizeof(struct signalfd_siginfo); i++) {
+            switch (info[i].ssi_signo) {
+                case SIGCHLD:
+                    child = 1;  // Reaped once below, waitpid() collects every child at once
+                    break;
+                case SIGINT:
+                    handle_int();
+                    break;
+                case SIGTSTP:
+                    handle_tstp();
+                    break;
+            }
+            count++;
+        }
+    }
+    if (n < 0 && errno != EAGAIN)
+        unix_error("Read signalfd error");
+
+    if (child)
+        handle_child();
+    return count;
+}
+
+void waitevents() {
+    struct pollfd pfd = {sfd, POLLIN, 0};
+    while (dispatchevents() == 0)
+        if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+            unix_error("Poll error");
+}
+
+void waitfds(int *fds, size_t nb_fds) {
+    struct pollfd pfds[nb_fds + 1];
+    pfds[0] = (struct pollfd) {sfd, POLLIN, 0};
+    for (size_t i = 0; i < nb_fds; i++)
+        pfds[i + 1] = (struct pollfd) {fds[i], POLLIN, 0};
+
+    while (dispatchevents() == 0) {
+        if (poll(pfds, nb_fds + 1, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            unix_error("Poll error");
+        }
+        for (size_t i = 1; i <= nb_fds; i++) {
+            if (pfds[i].revents != 0) {
+                handle_child();  // No need to wait for the SIGCHLD, the signalfd is read by the next call anyway
+                return;
+            }
+        }
+    }
+}
+
+int waitchild(pid_t pid) {
+    int pidfd = syscall(SYS_pidfd_open, pid, 0);
+
+    helper = pid;
+    while (helper == pid) {
+        if (pidfd >= 0)
+            waitfds(&pidfd, 1);
+        else
+            waitevents();
+    }
+    if (pidfd >= 0)
+        close(pidfd);
+    return helper_status;
+}
+
+void waitinput() {
+    struct epoll_event ev;
+
+    dispatchevents();
+    // The next line may already be in the input buffer of readcmd(), epoll would not tell
+    if (!stdin_polled || inputpending())
+        return;
+
+    while (1) {
+        if (epoll_wait(epfd, &ev, 1, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            unix_error("Epoll_wait error");
+        }
+        if (ev.data.fd != sfd)
+            return;  // Standard input is readable
+        dispatchevents();
+    }
+}
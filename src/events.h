@@ -0,0 +1,56 @@
+#ifndef TP_SHELL_SR_2023_EVENTS_H
+#define TP_SHELL_SR_2023_EVENTS_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/* The shell does not install any signal handler : SIGCHLD, SIGINT and SIGTSTP are blocked and read from a signalfd,
+ * then handled synchronously (reaping children, updating the jobs, forwarding to the foreground Job).
+ * The signalfd and standard input are watched by a single epoll instance.
+ */
+
+/* initevents - Block the handled signals and create the signalfd and epoll instances
+ * Arguments :
+ *  - print - 1 if job notifications (like "Suspended") should be printed, 0 otherwise
+ * Return value : None
+ */
+void initevents(int print);
+
+/* dispatchevents - Handle every pending signal without blocking
+ * Arguments : None
+ * Return value : The number of signals handled
+ */
+int dispatchevents(void);
+
+/* waitevents - Block until at least one signal has been handled
+ * Arguments : None
+ * Return value : None
+ */
+void waitevents(void);
+
+/* waitfds - Block until one of the given fds is readable or at least one signal has been handled
+ * Arguments :
+ *  - fds - The fds to watch, along with the signalfd, pidfds of children in practice
+ *  - nb_fds - The number of fds
+ * Return value : None
+ * Notes : Children are reaped right away when one of the fds is readable, as a pidfd is readable once its process
+ *         terminated, even if the SIGCHLD was not read yet
+ */
+void waitfds(int *fds, size_t nb_fds);
+
+/* waitchild - Wait for a child of the shell that is not part of a Job, handling signals meanwhile
+ * Arguments :
+ *  - pid - The pid of the child, forked by an internal command executed by the shell to do what could block it
+ * Return value : The wait status of the child
+ * Notes : A SIGINT is forwarded to the child, along with the foreground Job
+ */
+int waitchild(pid_t pid);
+
+/* waitinput - Handle signals until standard input is readable
+ * Arguments : None
+ * Return value : None
+ * Notes : Returns right away if readcmd() already buffered the next line, or if standard input is a regular file
+ */
+void waitinput(void);
+
+#endif //TP_SHELL_SR_2023_EVENTS_H
@@ -1,27 +1,57 @@
 #include "jobs.h"
 #include "readcmd.h"
 #include "csapp.h"
+#include "events.h"
+#include "options.h"
+#include "stats.h"
+#include "trace.h"
 #include <time.h>
+#include <sys/resource.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+// Time and resources used by one process of a job
+typedef struct _stage {
+    long long endtime;   // Time during which the job was running until the process terminated, in nanoseconds, 0
+                         // while the process is alive
+    struct rusage usage; // Resources used by the process, as given by wait4() once it terminated
+    int status;          // Wait status of the process once it terminated
+} Stage;
 
 typedef struct _job {
-    int id;            // Job id
-    char *cmd;         // Corresponding command line
-    int status;        // Current status of the job, 0: Running, 1: Stopped, 2: Done
-    time_t starttime;  // Timestamp of the start of the job
-    time_t pausetime;  // Timestamp of the last pause of the job, or of its termination
-    pid_t *pids;       // Array of pids, the pids of the processes executing the commands in the command line, a
-                       // negative pid designate a terminated processes
-    size_t nb_pids;    // Number of pids in the array
+    int id;              // Job id
+    char *cmd;           // Corresponding command line
+    int status;          // Current status of the job, 0: Running, 1: Stopped, 2: Done, 3: Queued
+    long long starttime; // Monotonic timestamp of the start of the job in nanoseconds, shifted by the time it was paused
+    long long pausetime; // Monotonic timestamp of the last pause of the job, or of its termination, in nanoseconds
+    struct rusage usage; // Resources used by the processes of the job that were reaped, see addusage()
+    pid_t *pids;         // Array of pids, the pids of the processes executing the commands in the command line, a
+                         // negative pid designate a terminated processes
+    Stage *stages;       // Array of nb_pids stages, the time and resources used by the process of each pid
+    size_t nb_pids;      // Number of pids in the array
+    size_t nb_alive;     // Number of pids not terminated yet
+    struct _job *newer;  // Job created right after this one, NULL if this is the last one
+    struct _job *older;  // Job created right before this one, NULL if this is the first one
+    int slab;            // Size class of the block holding the Job, its stages, its pids and its cmd, -1 if not
+                         // recycled
+    int waitstatus;      // Wait status deciding the exit status of the job (see setdone()), valid once it is Done
+    Cmdline *line;       // Copy of the command line of a queued job (see copycmd()), NULL once it is launched
+    struct _job *next;   // Next queued job, in FIFO order, NULL if this is the last one
+    int delayed;         // 1 if the job was queued before being launched, see waitqueue()
+    int shelllast;       // Wait status of the last command if it is not a process (see setshellstatus()), -1 otherwise
+    int shellfail;       // Wait status of the last command that is not a process and failed, 0 if none did
+    size_t shellfail_at; // Number of processes of the job launched before that command
 } Job;
 
-// Linked list structuration of the jobs
-typedef struct _joblist {
-    struct _joblist *next;
-    Job *job;
-} JobList;
+// Element of the pid map, open addressing hash table finding the Job of a pid
+typedef struct _pidentry {
+    pid_t pid;     // Positive pid, 0 if the slot is empty
+    Job *job;      // Job owning the pid
+    size_t index;  // Index of the pid in job->pids
+} PidEntry;
 
 #define P_PID(pid) (pid < 0 ? -pid : pid)   // Return the pid of a pid (the positive counterpart) to make sure it is positive
 #define P_PGID(pid) (pid < 0 ? pid : -pid)  // Returns the pgid of a pid (the negative counterpart)
@@ -30,336 +60,780 @@ typedef struct _joblist {
 #define S_RUNNING 0
 #define S_STOPPED 1
 #define S_DONE 2
+#define S_QUEUED 3
 
-static JobList *jobs;                 // Global variable : linked list of jobs
-static Job *fg;                       // Global variable : pointer to the foreground job
-static sigset_t mask_all, prev_mask;  // Used to block signals until access to global variables is done
+#define INIT_TABLE_SIZE 16   // Initial number of slots of the job table
+#define INIT_PIDMAP_SIZE 64  // Initial number of slots of the pid map, always a power of 2
+#define INIT_IDMAP_WORDS 1   // Initial number of words of the id bitmap
+#define WORD_BITS (8 * sizeof(unsigned long))
+#define SLAB_MIN_SHIFT 7     // Smallest block : 128 bytes
+#define SLAB_MAX_SHIFT 16    // Largest recycled block : 64 KiB, bigger jobs are allocated and freed directly
+#define NB_SLABS (SLAB_MAX_SHIFT - SLAB_MIN_SHIFT + 1)
 
-/* getnewid - Get a new job identifier
+static Job **table;          // Global variable : jobs indexed by their id, NULL for the unused ids (0 is never used)
+static int table_size;       // Number of slots in the job table
+static int nb_jobs;          // Number of jobs in the job table
+static Job *jobs;            // Global variable : last created job, the others are chained through the older field
+static Job *fg;              // Global variable : pointer to the foreground job
+static PidEntry *pidmap;     // Global variable : pid map, linear probing
+static size_t pidmap_size;   // Number of slots in the pid map
+static size_t pidmap_count;  // Number of pids in the pid map
+static unsigned long *idmap; // Global variable : bitmap of the used job ids, bit i of word w is id w * WORD_BITS + i
+static size_t idmap_words;   // Number of words in the id bitmap
+static size_t idmap_hint;    // Every id of the words before this one is used
+static Job *slabs[NB_SLABS]; // Global variable : free blocks of each size class, chained through their older field
+static Job lastfg;           // Global variable : copy of the last job that left the foreground, lastfg.id is 0 if none
+static Stage *laststages;    // Copy of the stages of lastfg, the block of the job itself may be recycled
+static pid_t *lastpids;      // Copy of the pids of lastfg
+static size_t lastfg_cap;    // Number of stages and pids that fit in laststages and lastpids
+static Job *queue_head;      // Global variable : first queued job, the next to be launched
+static Job *queue_tail;      // Last queued job
+static long nb_running;      // Number of jobs in the "Running" state, queued jobs are launched while it is under maxjobs()
+static long nproc;           // Number of online processors, the default limit of running jobs
+static void (*launcher)(Cmdline *l, int job_id);  // Function launching the queued jobs, see setlauncher()
+static unsigned long nb_done; // Number of jobs that became Done, waitanyjob() waits for it to change
+static int lastdone;          // Id of the last job that became Done
+static int lastdone_status;   // Exit status of the last job that became Done
+
+/* now - Get the current monotonic time
  * Arguments : None
- * Return value : The lowest available job id
+ * Return value : The time in nanoseconds
  */
-static int getnewid() {
-    // Source : https://www.geeksforgeeks.org/find-the-smallest-positive-number-missing-from-an-unsorted-array/
-    // Complexity : O(n)
+static long long now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* addtimeval - Add a timeval to another
+ * Arguments :
+ *  - acc - The timeval to add to
+ *  - tv - The timeval to add
+ * Return value : None
+ */
+static void addtimeval(struct timeval *acc, struct timeval *tv) {
+    acc->tv_sec += tv->tv_sec;
+    acc->tv_usec += tv->tv_usec;
+    if (acc->tv_usec >= 1000000) {
+        acc->tv_sec++;
+        acc->tv_usec -= 1000000;
+    }
+}
+
+/* addusage - Aggregate the resources used by a process into the resources used by a Job
+ * Arguments :
+ *  - acc - The resources used by the Job
+ *  - ru - The resources used by the process, as given by wait4()
+ * Return value : None
+ * Notes : Times, page faults and context switches are summed, the max RSS is the max RSS of the biggest process
+ */
+static void addusage(struct rusage *acc, struct rusage *ru) {
+    addtimeval(&acc->ru_utime, &ru->ru_utime);
+    addtimeval(&acc->ru_stime, &ru->ru_stime);
+    if (ru->ru_maxrss > acc->ru_maxrss)
+        acc->ru_maxrss = ru->ru_maxrss;
+    acc->ru_minflt += ru->ru_minflt;
+    acc->ru_majflt += ru->ru_majflt;
+    acc->ru_inblock += ru->ru_inblock;
+    acc->ru_oublock += ru->ru_oublock;
+    acc->ru_nvcsw += ru->ru_nvcsw;
+    acc->ru_nivcsw += ru->ru_nivcsw;
+}
+
+/* leavefg - Remove the foreground Job from the foreground, keeping a copy of it for getjobusage()
+ * Arguments : None
+ * Return value : None
+ */
+static void leavefg() {
+    if (fg->nb_pids > lastfg_cap) {
+        lastfg_cap = fg->nb_pids;
+        laststages = (Stage *) realloc(laststages, sizeof(Stage) * lastfg_cap);
+        lastpids = (pid_t *) realloc(lastpids, sizeof(pid_t) * lastfg_cap);
+    }
+    lastfg = *fg;
+    lastfg.stages = laststages;  // The copy does not own anything from the block of the Job, which may be recycled
+    lastfg.pids = lastpids;
+    lastfg.cmd = NULL;
+    memcpy(laststages, fg->stages, sizeof(Stage) * fg->nb_pids);
+    memcpy(lastpids, fg->pids, sizeof(pid_t) * fg->nb_pids);
+    fg = NULL;
+}
+
+/* pidslot - Get the first slot to probe for a pid in the pid map
+ * Arguments :
+ *  - pid - The (positive) pid
+ * Return value : The index of the slot
+ */
+static size_t pidslot(pid_t pid) {
+    return ((unsigned int) pid * 2654435761U) & (pidmap_size - 1);  // Knuth's multiplicative hash
+}
+
+/* pidmapfind - Find the entry of a pid in the pid map
+ * Arguments :
+ *  - pid - The (positive) pid
+ * Return value : A pointer to the entry if found, NULL otherwise
+ */
+static PidEntry *pidmapfind(pid_t pid) {
+    if (pidmap_size == 0)
+        return NULL;
+    for (size_t i = pidslot(pid); pidmap[i].pid != 0; i = (i + 1) & (pidmap_size - 1))
+        if (pidmap[i].pid == pid)
+            return &pidmap[i];
+    return NULL;
+}
+
+/* pidmapinsert - Map a pid to its Job in the pid map, replacing the previous Job of this pid if any
+ * Arguments :
+ *  - pid - The (positive) pid
+ *  - job - The Job owning the pid
+ *  - index - The index of the pid in job->pids
+ * Return value : None
+ */
+static void pidmapinsert(pid_t pid, Job *job, size_t index) {
+    // Keep the load factor under 1/2 so that probing sequences stay short
+    if (2 * (pidmap_count + 1) > pidmap_size) {
+        PidEntry *old = pidmap;
+        size_t old_size = pidmap_size;
+        pidmap_size = (old_size == 0) ? INIT_PIDMAP_SIZE : old_size * 2;
+        pidmap = (PidEntry *) calloc(pidmap_size, sizeof(PidEntry));
+        pidmap_count = 0;
+        for (size_t i = 0; i < old_size; i++)
+            if (old[i].pid != 0)
+                pidmapinsert(old[i].pid, old[i].job, old[i].index);
+        free(old);
+    }
 
-    // n is the highest job id
-    int n = 1;
-    JobList *jl;
-    for (jl = jobs; jl != NULL; jl = jl->next)
-        if (jl->job->id > n)
-            n = jl->job->id;
+    size_t i = pidslot(pid);
+    while (pidmap[i].pid != 0 && pidmap[i].pid != pid)
+        i = (i + 1) & (pidmap_size - 1);
+    if (pidmap[i].pid == 0)
+        pidmap_count++;
+    // A pid reused by the system while the Done job of its previous process was not notified yet goes to the new job
+    pidmap[i].pid = pid;
+    pidmap[i].job = job;
+    pidmap[i].index = index;
+}
 
-    // To mark the occurrence of elements. 0 is "false" ans 1 is "true"
-    char present[n + 1];
-    for (int i = 0; i <= n; i++)
-        present[i] = 0;
+/* pidmapremove - Remove a pid from the pid map, if it still belongs to the given Job
+ * Arguments :
+ *  - pid - The (positive) pid
+ *  - job - The Job the pid must belong to
+ * Return value : None
+ */
+static void pidmapremove(pid_t pid, Job *job) {
+    PidEntry *e = pidmapfind(pid);
+    if (e == NULL || e->job != job)
+        return;
 
-    // Mark the occurrences
-    for (jl = jobs; jl != NULL; jl = jl->next)
-        present[jl->job->id] = 1;
+    // Backward shift deletion : move back the following entries of the cluster that may not be reachable anymore
+    size_t hole = e - pidmap;
+    size_t i = hole;
+    while (1) {
+        i = (i + 1) & (pidmap_size - 1);
+        if (pidmap[i].pid == 0)
+            break;
+        size_t home = pidslot(pidmap[i].pid);
+        // The entry can fill the hole iff its home slot is not cyclically in ]hole, i]
+        if (((i - home) & (pidmap_size - 1)) >= ((i - hole) & (pidmap_size - 1))) {
+            pidmap[hole] = pidmap[i];
+            hole = i;
+        }
+    }
+    pidmap[hole].pid = 0;
+    pidmap_count--;
+}
 
-    // Find the first element which didn't appear in the original array
-    for (int i = 1; i <= n; i++)
-        if (present[i] == 0)
-            return i;
+/* getnewid - Get a new job identifier
+ * Arguments : None
+ * Return value : The lowest available job id
+ */
+static int getnewid() {
+    // Complexity : O(1) amortized, first zero bit of the id bitmap starting from the first word that has one
+    for (size_t w = idmap_hint; w < idmap_words; w++) {
+        if (idmap[w] != ~0UL) {
+            idmap_hint = w;
+            return (int) (w * WORD_BITS + __builtin_ctzl(~idmap[w]));
+        }
+    }
+    idmap_hint = idmap_words;
+    return (idmap_words == 0) ? 1 : (int) (idmap_words * WORD_BITS);  // Every id is used, the bitmap will grow
+}
 
-    // If the original array was of the type {1, 2, 3} in its sorted form
-    return n + 1;
+/* useid - Mark a job id as used in the id bitmap
+ * Arguments :
+ *  - id - The job id
+ * Return value : None
+ */
+static void useid(int id) {
+    size_t w = id / WORD_BITS;
+    if (w >= idmap_words) {
+        size_t old_words = idmap_words;
+        idmap_words = (old_words == 0) ? INIT_IDMAP_WORDS : old_words * 2;
+        while (w >= idmap_words)
+            idmap_words *= 2;
+        idmap = (unsigned long *) realloc(idmap, sizeof(unsigned long) * idmap_words);
+        memset(idmap + old_words, 0, sizeof(unsigned long) * (idmap_words - old_words));
+        idmap[0] |= 1UL;  // Id 0 is never used
+    }
+    idmap[w] |= 1UL << (id % WORD_BITS);
 }
 
-/* createjoblist - Create a new JobList (element of linked list)
+/* releaseid - Mark a job id as available in the id bitmap
  * Arguments :
- *  - job - A pointer to the Job to add to the JobList
- * Return value : A pointer to the newly created JobList
+ *  - id - The job id
+ * Return value : None
  */
-static JobList *createjoblist(Job *job) {
-    JobList *jl = (JobList *) malloc(sizeof(JobList));
-    jl->next = NULL;
-    jl->job = job;
-    return jl;
+static void releaseid(int id) {
+    size_t w = id / WORD_BITS;
+    idmap[w] &= ~(1UL << (id % WORD_BITS));
+    if (w < idmap_hint)
+        idmap_hint = w;
 }
 
-/* createjob - Create a new Job
+/* allocjob - Get a block for a Job, recycled from the free blocks of its size class if possible
+ * Arguments :
+ *  - size - The size of the Job with its stages, pids and cmd
+ * Return value : A pointer to the block, its slab field is set
+ */
+static Job *allocjob(size_t size) {
+    int shift = SLAB_MIN_SHIFT;
+    while (((size_t) 1 << shift) < size)
+        shift++;
+
+    Job *job;
+    if (shift > SLAB_MAX_SHIFT) {
+        job = (Job *) malloc(size);
+        job->slab = -1;
+    } else if (slabs[shift - SLAB_MIN_SHIFT] != NULL) {
+        job = slabs[shift - SLAB_MIN_SHIFT];
+        slabs[shift - SLAB_MIN_SHIFT] = job->older;
+    } else {
+        job = (Job *) malloc((size_t) 1 << shift);
+        job->slab = shift - SLAB_MIN_SHIFT;
+    }
+    return job;
+}
+
+/* createjob - Create a new Job, stored in a single block with its stages, its pids and its cmd
  * Arguments :
  *  - cmd - The raw command line corresponding to the job
  *  - pids - An array of pids, refer to the struct Job for more information
  *  - nb_pids - The number of pids in the array
  * Return value : A pointer to the newly created Job
+ * Notes : pids may be NULL to only make room for nb_pids pids
  */
 static Job *createjob(char *cmd, pid_t *pids, size_t nb_pids) {
-    Job *job = (Job *) malloc(sizeof(Job));
+    size_t cmd_len = strlen(cmd) + 1;
+    // The stages come first, they need the alignment of the Job
+    Job *job = allocjob(sizeof(Job) + (sizeof(Stage) + sizeof(pid_t)) * nb_pids + sizeof(char) * cmd_len);
     job->id = getnewid();
     job->status = S_RUNNING;
-    job->starttime = time(NULL);
+    job->starttime = now();
     job->pausetime = job->starttime;
+    memset(&job->usage, 0, sizeof(struct rusage));
     job->nb_pids = nb_pids;
-    job->pids = (pid_t *) malloc(sizeof(pid_t) * nb_pids);
-    memcpy(job->pids, pids, sizeof(pid_t) * nb_pids);
-    job->cmd = (char *) malloc(sizeof(char) * (strlen(cmd) + 1));
-    strcpy(job->cmd, cmd);
+    job->nb_alive = nb_pids;
+    job->waitstatus = 0;
+    job->stages = (Stage *) (job + 1);
+    memset(job->stages, 0, sizeof(Stage) * nb_pids);
+    job->pids = (pid_t *) (job->stages + nb_pids);
+    if (pids != NULL)
+        memcpy(job->pids, pids, sizeof(pid_t) * nb_pids);
+    job->cmd = (char *) (job->pids + nb_pids);
+    memcpy(job->cmd, cmd, sizeof(char) * cmd_len);
+    job->newer = NULL;
+    job->older = NULL;
+    job->line = NULL;
+    job->next = NULL;
+    job->delayed = 0;
+    job->shelllast = -1;
+    job->shellfail = 0;
+    job->shellfail_at = 0;
     return job;
 }
 
-/* freejob - Free the memory allocated to a Job
+/* freejob - Give the block of a Job back to the free blocks of its size class
  * Arguments :
  *  - job - A pointer to the Job to free
  * Return value : None
  */
 static void freejob(Job *job) {
-    free(job->cmd);
-    free(job->pids);
-    free(job);
+    free(job->line);
+    if (job->slab == -1) {
+        free(job);
+        return;
+    }
+    job->older = slabs[job->slab];
+    slabs[job->slab] = job;
 }
 
-/* removejob - Remove a Job from the linked list of jobs
- * Arguments :
- *  - job_id - The id of the Job to remove
+/* freeslabs - Free every block of the free blocks of every size class
+ * Arguments : None
  * Return value : None
  */
-static void removejob(int job_id) {
-    JobList *jl = jobs;
-    JobList *prev = NULL;
-    while (jl != NULL) {
-        if (jl->job->id == job_id) {
-            if (prev == NULL)
-                jobs = jl->next;
-            else
-                prev->next = jl->next;
-            freejob(jl->job);
-            free(jl);
-            return;
+static void freeslabs() {
+    for (int i = 0; i < NB_SLABS; i++) {
+        while (slabs[i] != NULL) {
+            Job *older = slabs[i]->older;
+            free(slabs[i]);
+            slabs[i] = older;
         }
-        prev = jl;
-        jl = jl->next;
     }
 }
 
-/* findjob - Find a Job by its id in the linked list of jobs
+/* insertjob - Insert a Job in the job table, the pid map and as the last created job
+ * Arguments :
+ *  - job - A pointer to the Job to insert
+ * Return value : None
+ */
+static void insertjob(Job *job) {
+    if (job->id >= table_size) {
+        int old_size = table_size;
+        table_size = (old_size == 0) ? INIT_TABLE_SIZE : old_size * 2;
+        table = (Job **) realloc(table, sizeof(Job *) * table_size);
+        memset(table + old_size, 0, sizeof(Job *) * (table_size - old_size));
+    }
+    table[job->id] = job;
+    useid(job->id);
+    statsrecord(ST_JOBS, ++nb_jobs);
+
+    for (size_t i = 0; i < job->nb_pids; i++)
+        pidmapinsert(P_PID(job->pids[i]), job, i);
+
+    job->older = jobs;
+    if (jobs != NULL)
+        jobs->newer = job;
+    jobs = job;
+}
+
+/* removejob - Remove a Job from the job table and free it
+ * Arguments :
+ *  - job - A pointer to the Job to remove
+ * Return value : None
+ */
+static void removejob(Job *job) {
+    table[job->id] = NULL;
+    releaseid(job->id);
+    nb_jobs--;
+
+    for (size_t i = 0; i < job->nb_pids; i++)
+        pidmapremove(P_PID(job->pids[i]), job);
+
+    if (job->newer != NULL)
+        job->newer->older = job->older;
+    else
+        jobs = job->older;
+    if (job->older != NULL)
+        job->older->newer = job->newer;
+
+    freejob(job);
+}
+
+/* findjob - Find a Job by its id in the job table
  * Arguments :
  *  - job_id - The id of the Job to find
  * Return value : A pointer to the Job if found, NULL otherwise
  */
 static Job *findjob(int job_id) {
-    JobList *jl = jobs;
-    while (jl != NULL) {
-        if (jl->job->id == job_id)
-            return jl->job;
-        jl = jl->next;
-    }
-    return NULL;
+    if (job_id <= 0 || job_id >= table_size)
+        return NULL;
+    return table[job_id];
 }
 
-/* pidfindjob - Find a Job by one of its pid in the linked list of jobs
+/* pidfindjob - Find a Job by one of its pid in the pid map
  * Arguments :
  *  - pid - The pid of one of the processes in the Job to find
  * Return value : A pointer to the Job if found, NULL otherwise
  */
 static Job *pidfindjob(pid_t pid) {
-    JobList *jl = jobs;
-    while (jl != NULL) {
-        for (size_t i = 0; i < jl->job->nb_pids; i++)
-            if (P_PID(jl->job->pids[i]) == pid)
-                return jl->job;
-        jl = jl->next;
-    }
-    return NULL;
+    PidEntry *e = pidmapfind(pid);
+    if (e == NULL)
+        return NULL;
+    return e->job;
 }
 
-/* pgidfindjob - Find a Job by its pgid in the linked list of jobs
+/* pgidfindjob - Find a Job by its pgid in the pid map
  * Arguments :
  *  - pgid - The pgid of the Job to find, that is the pid of the first process of the job
  * Return value : A pointer to the Job if found, NULL otherwise
  */
 static Job *pgidfindjob(pid_t pgid) {
     // Hypothesis : pgid is the pid of the first process of the job
-    JobList *jl = jobs;
-    while (jl != NULL) {
-        if (P_PID(jl->job->pids[0]) == pgid)
-            return jl->job;
-        jl = jl->next;
+    PidEntry *e = pidmapfind(pgid);
+    if (e == NULL || e->index != 0)
+        return NULL;
+    return e->job;
+}
+
+/* tracejobstate - Trace a change of state of every process of a Job that did not terminate yet (see trace.h)
+ * Arguments :
+ *  - job - A pointer to the Job
+ *  - state - The name of the new state
+ * Return value : None
+ */
+static void tracejobstate(Job *job, char *state) {
+    for (size_t i = 0; i < job->nb_pids; i++)
+        if (!P_ISTERMINATED(job->pids[i]))
+            tracestate(job->pids[i], state);
+}
+
+/* exitstatus - Get the exit status of a process, like sh
+ * Arguments :
+ *  - status - The wait status of the process
+ * Return value : The exit code of the process, or 128 + the signal that killed it
+ */
+static int exitstatus(int status) {
+    if (WIFSIGNALED(status))
+        return 128 + WTERMSIG(status);
+    return WEXITSTATUS(status);
+}
+
+/* setwaitstatus - Compute the wait status deciding the exit status of a Job, its processes must have terminated
+ * Arguments :
+ *  - job - A pointer to the Job
+ * Return value : None
+ * Notes : The status of the Job is the one of its last command, or with the "pipefail" option the one of its last
+ *         command that failed, like sh. The commands that are not processes are accounted for by setshellstatus().
+ *         A Job without any process nor such command failed to launch its commands, like sh it gets 127
+ */
+static void setwaitstatus(Job *job) {
+    if (job->shelllast != -1)
+        job->waitstatus = job->shelllast;
+    else if (job->nb_pids == 0)
+        job->waitstatus = W_EXITCODE(127, 0);
+    else
+        job->waitstatus = job->stages[job->nb_pids - 1].status;
+    if (getoption(OPT_PIPEFAIL)) {
+        for (size_t i = job->nb_pids + 1; i-- > 0;) {
+            // The failed command that is not a process comes right after the processes launched before it
+            if (job->shellfail != 0 && job->shellfail_at == i) {
+                job->waitstatus = job->shellfail;
+                break;
+            }
+            if (i > 0 && exitstatus(job->stages[i - 1].status) != 0) {
+                job->waitstatus = job->stages[i - 1].status;
+                break;
+            }
+        }
     }
-    return NULL;
 }
 
-/* _addjob - Add a new Job to the linked list of jobs, not Signal safe version
+/* setdone - Switch a Job to the "Done" state, the terminated processes must have been deleted
  * Arguments :
- *  - cmd - The raw command line corresponding to the job
- *  - pids - An array of pids, refer to the struct Job for more information
- *  - nb_pids - The number of pids in the array
- * Return value : The id of the newly created Job
+ *  - job - A pointer to the Job
+ * Return value : None
+ * Notes : The exit status of the Job is computed by setwaitstatus()
+ */
+static void setdone(Job *job) {
+    setwaitstatus(job);
+    job->status = S_DONE;
+    nb_done++;
+    lastdone = job->id;
+    lastdone_status = exitstatus(job->waitstatus);
+}
+
+/* openpidfds - Open a pidfd for each process of a Job that did not terminate yet
+ * Arguments :
+ *  - job - A pointer to the Job
+ *  - fds - Filled with the pidfds, must have room for the nb_alive pids of the Job
+ * Return value : The number of pidfds opened, a process that cannot be opened is watched through SIGCHLD only
+ */
+static size_t openpidfds(Job *job, int *fds) {
+    size_t nb_fds = 0;
+    for (size_t i = 0; i < job->nb_pids; i++) {
+        if (P_ISTERMINATED(job->pids[i]))
+            continue;
+        // No wrapper before glibc 2.36, pidfds are close-on-exec anyway
+        int fd = (int) syscall(SYS_pidfd_open, job->pids[i], 0);
+        if (fd >= 0)
+            fds[nb_fds++] = fd;
+    }
+    return nb_fds;
+}
+
+/* closepidfds - Close the pidfds opened by openpidfds()
+ * Arguments :
+ *  - fds - The pidfds
+ *  - nb_fds - The number of pidfds
+ * Return value : None
+ */
+static void closepidfds(int *fds, size_t nb_fds) {
+    for (size_t i = 0; i < nb_fds; i++)
+        Close(fds[i]);
+}
+
+/* maxjobs - Get the maximum number of running Jobs
+ * Arguments : None
+ * Return value : The value of the "maxjobs" option, or the number of processors if it is 0
+ */
+static long maxjobs() {
+    long max = getoption(OPT_MAXJOBS);
+    return (max > 0) ? max : nproc;
+}
+
+/* dequeue - Remove a queued Job from the queue
+ * Arguments :
+ *  - job - A pointer to the queued Job
+ * Return value : None
  */
-static int _addjob(char *cmd, pid_t *pids, size_t nb_pids) {
-    JobList *jl = createjoblist(createjob(cmd, pids, nb_pids));
-    jl->next = jobs;
-    jobs = jl;
-    return jl->job->id;
+static void dequeue(Job *job) {
+    Job **link = &queue_head;
+    Job *prev = NULL;
+    while (*link != job) {
+        prev = *link;
+        link = &prev->next;
+    }
+    *link = job->next;
+    if (queue_tail == job)
+        queue_tail = prev;
+    job->next = NULL;
 }
 
-/* _stopjob - Stop a Job (send SIGTSTP to group process), not Signal safe version
+/* launchjob - Launch a queued Job with the launcher, which gives its processes to startjob()
  * Arguments :
- *  - job_id - The id of the Job to stop
- * Return value : 0 if the Job was stopped
- *                1 if the Job was not found
- *                2 if the Job was already stopped or terminated
+ *  - job - A pointer to the queued Job
+ * Return value : None
  */
-static int _stopjob(int job_id) {
+static void launchjob(Job *job) {
+    Cmdline *l = job->line;
+    // Detached from the Job : a forked child frees the jobs but still executes the command line
+    job->line = NULL;
+    dequeue(job);
+    launcher(l, job->id);
+    free(l);
+}
+
+/* schedjobs - Launch the queued Jobs, in FIFO order, while less than maxjobs() Jobs are running
+ * Arguments : None
+ * Return value : None
+ */
+static void schedjobs() {
+    if (launcher == NULL)
+        return;
+    while (queue_head != NULL && nb_running < maxjobs())
+        launchjob(queue_head);
+}
+
+// Public functions : see jobs.h for documentation
+// None of them is reentrant : signals are never handled asynchronously, they are read from a signalfd by the event
+// loop (see events.h) which calls these functions from the main flow of execution.
+
+void initjobs() {
+    table = NULL;
+    table_size = 0;
+    nb_jobs = 0;
+    jobs = NULL;
+    fg = NULL;
+    pidmap = NULL;
+    pidmap_size = 0;
+    pidmap_count = 0;
+    idmap = NULL;
+    idmap_words = 0;
+    idmap_hint = 0;
+    lastfg.id = 0;
+    queue_head = NULL;
+    queue_tail = NULL;
+    nb_running = 0;
+    if ((nproc = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+        nproc = 1;
+}
+
+int addjob(char *cmd, pid_t *pids, size_t nb_pids) {
+    Job *job = createjob(cmd, pids, nb_pids);
+    insertjob(job);
+    nb_running++;
+    tracejob(job->id, job->cmd, 1);
+    return job->id;
+}
+
+void setlauncher(void (*launch)(Cmdline *l, int job_id)) {
+    launcher = launch;
+}
+
+int mustqueue() {
+    return queue_head != NULL || nb_running >= maxjobs();
+}
+
+int queuejob(Cmdline *l) {
+    size_t nb_cmds = 0;
+    while (l->seq[nb_cmds] != NULL)
+        nb_cmds++;
+
+    // Room is made for one pid per command, but the pids are only known once the job is launched
+    Job *job = createjob(l->raw, NULL, nb_cmds);
+    job->status = S_QUEUED;
+    job->delayed = 1;
+    job->nb_pids = 0;
+    job->nb_alive = 0;
+    job->line = copycmd(l);
+    insertjob(job);
+
+    if (queue_tail != NULL)
+        queue_tail->next = job;
+    else
+        queue_head = job;
+    queue_tail = job;
+    return job->id;
+}
+
+int startjob(int job_id, pid_t *pids, size_t nb_pids) {
+    Job *job = findjob(job_id);
+    if (job == NULL || job->status != S_QUEUED)
+        return 1;  // Job not found, or already launched
+
+    // The job only starts now, the time it spent in the queue is not accounted for
+    job->starttime = now();
+    job->pausetime = job->starttime;
+    job->nb_pids = nb_pids;
+    job->nb_alive = nb_pids;
+    memcpy(job->pids, pids, sizeof(pid_t) * nb_pids);
+    for (size_t i = 0; i < nb_pids; i++)
+        pidmapinsert(P_PID(pids[i]), job, i);
+
+    if (nb_pids == 0) {  // Nothing could be launched, the job is kept to be notified as "Done"
+        setdone(job);
+        if (job == fg)
+            leavefg();
+        return 0;
+    }
+    job->status = S_RUNNING;
+    nb_running++;
+    tracejob(job->id, job->cmd, 1);
+    return 0;
+}
+
+int stopjob(int job_id) {
     Job *job = findjob(job_id);
     if (job == NULL)
         return 1;  // Job not found
-    else if (job->status == S_STOPPED || job->status == S_DONE)
+    else if (job->status == S_STOPPED || job->status == S_DONE || job->status == S_QUEUED)
         return 2;  // Job already stopped
 
     Kill(P_PGID(job->pids[0]), SIGTSTP);
     return 0;
 }
 
-/* _contjob - Continue a Job (send SIGCONT to group process), not Signal safe version
- * Arguments :
- *  - job_id - The id of the Job to continue
- * Return value : 0 if the Job was continued
- *                1 if the Job was not found
- *                2 if the Job was already running or terminated
- */
-static int _contjob(int job_id) {
+int contjob(int job_id) {
     Job *job = findjob(job_id);
     if (job == NULL)
         return 1;  // Job not found
-    if (job->status == S_RUNNING || job->status == S_DONE)
+    if (job->status == S_RUNNING || job->status == S_DONE || job->status == S_QUEUED)
         return 2;  // Job already running
 
     Kill(P_PGID(job->pids[0]), SIGCONT);
     return 0;
 }
 
-/* _termjob - Terminate a Job (send SIGTERM to group process), not Signal safe version
- * Arguments :
- *  - job_id - The id of the Job to terminate
- * Return value : 0 if the Job was terminated
- *                1 if the Job was not found
- *                2 if the Job was already terminated
- */
-static int _termjob(int job_id) {
+int termjob(int job_id) {
     Job *job = findjob(job_id);
     if (job == NULL)
         return 1;  // Job not found
-    if (job->status == S_DONE)
+    if (job->status == S_DONE || job->status == S_QUEUED)
         return 2;  // Job already terminated
 
     Kill(P_PGID(job->pids[0]), SIGTERM);
     return 0;
 }
 
-/* _deletejobpid - Delete a pid from a Job (put it to "Done" state), not Signal safe version
- * Arguments :
- *  - pid - The pid to delete
- * Return value : 0 if the pid was switched to the "terminated" state
- *                1 if the pid was not found
- * Notes : Effectively puts the Job in "Done" state iff all pids of the Job have been treated as "Terminated" beforehand
- */
-static int _deletejobpid(pid_t pid) {
-    Job *job = pidfindjob(pid);
-    if (job == NULL)
+int deletejobpid(pid_t pid, int status, struct rusage *usage) {
+    PidEntry *e = pidmapfind(pid);
+    if (e == NULL)
         return 1;  // Job not found
+    Job *job = e->job;
 
-    // Counting the number of terminated processes and marking the terminated process as well
-    int nb_term = 0;
-    for (int i = 0; i < job->nb_pids; i++) {
-        if (job->pids[i] == pid)
-            job->pids[i] = P_TERMINATE(job->pids[i]);
-        if (P_ISTERMINATED(job->pids[i]))
-            nb_term++;
+    // Marking the terminated process, the pid map gives its index directly
+    if (!P_ISTERMINATED(job->pids[e->index])) {
+        job->pids[e->index] = P_TERMINATE(job->pids[e->index]);
+        job->nb_alive--;
+        tracestate(pid, NULL);
+        job->stages[e->index].status = status;
+        job->stages[e->index].endtime = (job->status == S_STOPPED ? job->pausetime : now()) - job->starttime;
+        if (usage != NULL) {
+            job->stages[e->index].usage = *usage;
+            addusage(&job->usage, usage);
+        }
     }
 
-    if (nb_term == job->nb_pids) {     // If all processes of the command have terminated
-        if (job->status == S_RUNNING)  // If the job was not already stopped
-            job->pausetime = time(NULL);
-        job->status = S_DONE;
+    if (job->nb_alive == 0) {            // If all processes of the command have terminated
+        if (job->status == S_RUNNING) {  // If the job was not already stopped
+            job->pausetime = now();
+            nb_running--;
+        }
+        setdone(job);
+        tracejob(job->id, job->cmd, 0);
         if (job == fg) {  // If the job was in foreground, we can free it, otherwise keep it for later notification
-            removejob(job->id);
-            fg = NULL;
+            statsstart(ST_REAP);
+            leavefg();
+            removejob(job);
         }
+        schedjobs();  // The job may leave its place to a queued one
     }
     return 0;
 }
 
-/* _contjobpid - Put back a Job in "Running" state, not Signal safe version
- * Arguments :
- *  - pid - The pid of the Job to continue, only effective if the pid is the pid of the leader process
- * Return value : 0 if the Job was continued
- *                1 if the Job was not found
- */
-static int _contjobpid(pid_t pid) {
+int contjobpid(pid_t pid) {
     // Must be the pid of the leader process in order to consider it "running" again
     Job *job = pgidfindjob(pid);
     if (job == NULL)
         return 1;  // Job not found
 
+    if (job->status == S_STOPPED)
+        nb_running++;
     job->status = S_RUNNING;
-    job->starttime += time(NULL) - job->pausetime;
+    job->starttime += now() - job->pausetime;
+    tracejobstate(job, "Running");
     return 0;
 }
 
-/* _stopjobpid - Put a Job in "Stopped" state, not Signal safe version
- * Arguments :
- *  - pid - The pid of the Job to stop, only effective if the pid is the pid of the leader process
- * Return value : 0 if the Job was stopped
- *                1 if the Job was not found
- */
-static int _stopjobpid(pid_t pid) {
+int stopjobpid(pid_t pid) {
     // Must be the pid of the leader process in order to consider it "stopped"
     Job *job = pgidfindjob(pid);
     if (job == NULL)
         return 1;  // Job not found
 
-    if (job == fg)
-        fg = NULL;
+    if (job->status == S_RUNNING)
+        nb_running--;
     job->status = S_STOPPED;
-    job->pausetime = time(NULL);
+    job->pausetime = now();
+    tracejobstate(job, "Stopped");
+    if (job == fg)
+        leavefg();
+    schedjobs();  // A stopped job leaves its place to a queued one as well
     return 0;
 }
 
-/* _freejobs - Free all the Jobs, not Signal safe version
- * Arguments : None
- * Return value : None
- */
-static void _freejobs() {
-    JobList *jl = jobs;
-    JobList *prev = NULL;
-    while (jl != NULL) {
-        freejob(jl->job);
-        prev = jl;
-        jl = jl->next;
-        free(prev);
+void freejobs() {
+    Job *job = jobs;
+    while (job != NULL) {
+        Job *older = job->older;
+        freejob(job);
+        job = older;
     }
+    freeslabs();
+    free(table);
+    free(pidmap);
+    free(idmap);
+    free(laststages);
+    free(lastpids);
+    laststages = NULL;
+    lastpids = NULL;
+    lastfg_cap = 0;
+    initjobs();
 }
 
-/* _killjobs - Kill all the Jobs (send SIGKILL to all group processes) and free them, not Signal safe version
- * Arguments : None
- * Return value : None
- */
-static void _killjobs() {
-    JobList *jl = jobs;
-    while (jl != NULL) {
-        if (jl->job->status != S_DONE) {
-            Kill(P_PGID(jl->job->pids[0]), SIGKILL);
-            for (int i = 0; i < jl->job->nb_pids; i++)
-                if (!P_ISTERMINATED(jl->job->pids[i]))
-                    Waitpid(jl->job->pids[i], NULL, 0);
+void killjobs() {
+    for (Job *job = jobs; job != NULL; job = job->older) {
+        if (job->status != S_DONE && job->status != S_QUEUED) {
+            Kill(P_PGID(job->pids[0]), SIGKILL);
+            for (int i = 0; i < job->nb_pids; i++)
+                if (!P_ISTERMINATED(job->pids[i]))
+                    Waitpid(job->pids[i], NULL, 0);
         }
-        jl = jl->next;
     }
-    _freejobs();
+    freejobs();
 }
 
-/* _setfg - Set a Job as the foreground Job, not Signal safe version
- * Arguments :
- *  - job_id - The id of the Job to set as the foreground Job
- * Return value : 0 if the Job was set as the foreground Job
- *                1 if the Job was not found
- *                2 if a Job was already in foreground
- */
-static int _setfg(int job_id) {
+int setfg(int job_id) {
     if (fg != NULL)
         return 2;  // A job is already in foreground
 
@@ -368,250 +842,248 @@ static int _setfg(int job_id) {
         return 1;  // Job not found
 
     fg = job;
+    if (job->status == S_QUEUED && launcher != NULL)
+        launchjob(job);  // The user waits for it, it does not wait for its turn
     return 0;
 }
 
-/* _getfg - Get the id of the foreground Job, not Signal safe version
- * Arguments : None
- * Return value : The id of the foreground Job
- *                -1 if no Job is in foreground
- */
-static int _getfg() {
+int getfg() {
     if (fg == NULL)
         return -1;
     return fg->id;
 }
 
-/* _getlastjob - Get the id of the lastly created Job, not Signal safe version
- * Arguments : None
- * Return value : The id of the last Job
- *                -1 if no Job exists
- */
-static int _getlastjob() {
+int getlastjob() {
     if (jobs == NULL)
         return -1;
-    return jobs->job->id;
+    return jobs->id;
 }
 
-/* _getjob - Get the id of a Job, not Signal safe version
- * Arguments :
- *  - pid - The pid of the Job to get the id
- * Return value : The id of the Job
- *                -1 if the Job was not found
- */
-static int _getjob(pid_t pid) {
+int getjob(pid_t pid) {
     Job *job = pidfindjob(pid);
     if (job == NULL)
         return -1;
     return job->id;
 }
 
-/* _getjobpgid - Get the pgid of a Job (that is the pid of the process leader), not Signal safe version
- * Arguments :
- *  - job_id - The id of the Job to get the pgid from
- * Return value : The pgid of the Job
- *                -1 if the Job was not found
- */
-static pid_t _getjobpgid(int job_id) {
+pid_t getjobpgid(int job_id) {
     Job *job = findjob(job_id);
-    if (job == NULL)
+    if (job == NULL || job->nb_pids == 0)
         return -1;
     return P_PID(job->pids[0]);
 }
 
-/* _getjobcmd - Get the command line of a Job, not Signal safe version
+char *getjobcmd(int job_id) {
+    Job *job = findjob(job_id);
+    if (job == NULL)
+        return NULL;
+    return job->cmd;
+}
+
+/* usagejob - Find a Job by its id in the job table, or in the copy of the last job that left the foreground
  * Arguments :
- *  - job_id - The id of the Job to get the command line from
- * Return value : The raw command line of the Job
- *                NULL if the Job was not found
+ *  - job_id - The id of the Job to find
+ * Return value : A pointer to the Job (or its copy) if found, NULL otherwise
  */
-static char *_getjobcmd(int job_id) {
-    JobList *jl = jobs;
-    while (jl != NULL) {
-        if (jl->job->id == job_id)
-            return jl->job->cmd;
-        jl = jl->next;
+static Job *usagejob(int job_id) {
+    Job *job = findjob(job_id);
+    if (job == NULL && lastfg.id == job_id && job_id > 0)
+        job = &lastfg;  // Terminated in foreground, only its copy remains
+    return job;
+}
+
+int getjobusage(int job_id, long long *real, struct rusage *usage) {
+    Job *job = usagejob(job_id);
+    if (job == NULL)
+        return 1;  // Job not found
+
+    *real = (job->status == S_RUNNING ? now() : job->pausetime) - job->starttime;
+    *usage = job->usage;
+    return 0;
+}
+
+int getjobstatus(int job_id) {
+    Job *job = usagejob(job_id);
+    if (job == NULL)
+        return -1;  // Job not found
+
+    switch (job->status) {
+        case S_STOPPED:
+            return 128 + SIGTSTP;
+        case S_DONE:
+            return exitstatus(job->waitstatus);
+        default:
+            return -1;  // Not finished yet
     }
-    return NULL;
 }
 
-/* _printjobs - Print all the Jobs (nearly as the "jobs" command), not Signal safe version
- *              Also frees the Jobs that are "Done"
- * Arguments : None
- * Return value : None
- */
-static void _printjobs() {
+int setshellstatus(int job_id, size_t before, int last, int status) {
+    Job *job = usagejob(job_id);
+    if (job == NULL)
+        return 1;  // Job not found
+
+    if (last)
+        job->shelllast = W_EXITCODE(status & 0xff, 0);
+    if (status != 0) {  // Called in the order of the commands, the last one that failed is kept
+        job->shellfail = W_EXITCODE(status & 0xff, 0);
+        job->shellfail_at = before;
+    }
+    if (job->status == S_DONE) {  // Its processes already terminated
+        setwaitstatus(job);
+        if (lastdone == job->id)
+            lastdone_status = exitstatus(job->waitstatus);
+    }
+    return 0;
+}
+
+int getstageusage(int job_id, size_t i, pid_t *pid, long long *real, struct rusage *usage) {
+    Job *job = usagejob(job_id);
+    if (job == NULL || i >= job->nb_pids)
+        return 1;  // Job or stage not found
+
+    *pid = P_PID(job->pids[i]);
+    if (P_ISTERMINATED(job->pids[i]))
+        *real = job->stages[i].endtime;
+    else
+        *real = (job->status == S_RUNNING ? now() : job->pausetime) - job->starttime;
+    *usage = job->stages[i].usage;
+    return 0;
+}
+
+void printjobs(int verbose) {
     char *status;
+    char strstatus[16];
     char strtime[9];
     time_t exectime;
-    JobList *jl = jobs;
-    while (jl != NULL) {
-        switch (jl->job->status) {
+    pid_t pgid;
+    for (Job *job = jobs; job != NULL; job = job->older) {
+        if (job == fg)
+            continue;  // Internal commands executed by the shell itself may be part of the foreground job
+        switch (job->status) {
             case S_RUNNING:
                 status = "Running";
-                exectime = time(NULL) - jl->job->starttime;
+                exectime = (now() - job->starttime) / 1000000000LL;
                 break;
             case S_STOPPED:
                 status = "Suspended";
-                exectime = jl->job->pausetime - jl->job->starttime;
+                exectime = (job->pausetime - job->starttime) / 1000000000LL;
                 break;
             case S_DONE:
-                status = "Done";
-                exectime = jl->job->pausetime - jl->job->starttime;
+                // Like sh : "Done", "Exit <code>", or the description of the signal that killed the job
+                if (WIFSIGNALED(job->waitstatus))
+                    status = strsignal(WTERMSIG(job->waitstatus));
+                else if (WEXITSTATUS(job->waitstatus) != 0) {
+                    sprintf(strstatus, "Exit %d", WEXITSTATUS(job->waitstatus));
+                    status = strstatus;
+                } else
+                    status = "Done";
+                exectime = (job->pausetime - job->starttime) / 1000000000LL;
+                break;
+            case S_QUEUED:
+                status = "Queued";
+                exectime = 0;
                 break;
             default:
                 status = "Unknown";
                 exectime = 0;
         }
         sprintf(strtime, "%02ld:%02ld:%02ld", exectime / 3600, (exectime % 3600) / 60, exectime % 60); // HH:MM:SS
-        printf("[%d] %d  %-9s  %s  %s\n", jl->job->id, P_PID(jl->job->pids[0]), status, strtime, jl->job->cmd);
-        jl = jl->next;
-    }
-
-    // Free the jobs that are "Done", now that they have notified the user of their termination
-    jl = jobs;
-    JobList *prev = NULL;
-    while (jl != NULL) {
-        if (jl->job->status != S_DONE) {
-            prev = jl;
-            jl = jl->next;
+        pgid = (job->nb_pids > 0) ? P_PID(job->pids[0]) : 0;  // No process yet for a queued job
+        if (!verbose) {
+            printf("[%d] %d  %-9s  %s  %s\n", job->id, pgid, status, strtime, job->cmd);
             continue;
         }
-        if (prev == NULL) {  // First element is "Done"
-            jobs = jl->next;
-            freejob(jl->job);
-            free(jl);
-            jl = jobs;
-        } else {
-            prev->next = jl->next;
-            freejob(jl->job);
-            free(jl);
-            jl = prev->next;
-        }
+        // The max RSS of spawned processes is at least the one of the shell, see getjobusage()
+        printf("[%d] %d  %-9s  %s  user %ld.%03lds  sys %ld.%03lds  maxrss %ldk  csw %ld/%ld  %s\n", job->id,
+               pgid, status, strtime,
+               (long) job->usage.ru_utime.tv_sec, (long) job->usage.ru_utime.tv_usec / 1000,
+               (long) job->usage.ru_stime.tv_sec, (long) job->usage.ru_stime.tv_usec / 1000,
+               job->usage.ru_maxrss, job->usage.ru_nvcsw, job->usage.ru_nivcsw, job->cmd);
     }
-}
-
-
-// Public functions : see jobs.h for documentation
-// For the most part "Signal safe", that is : Signal handlers are mutually exclusive towards the global variables of
-// this file.
-
-void initjobs() {
-    Sigfillset(&mask_all);
-    jobs = NULL;
-    fg = NULL;
-}
-
-int addjob(char *cmd, pid_t *pids, size_t nb_pids) {
-    Sigprocmask(SIG_BLOCK, &mask_all, &prev_mask);
-    int res = _addjob(cmd, pids, nb_pids);
-    Sigprocmask(SIG_SETMASK, &prev_mask, NULL);
-    return res;
-}
 
-int stopjob(int job_id) {
-    Sigprocmask(SIG_BLOCK, &mask_all, &prev_mask);
-    int res = _stopjob(job_id);
-    Sigprocmask(SIG_SETMASK, &prev_mask, NULL);
-    return res;
-}
-
-int contjob(int job_id) {
-    Sigprocmask(SIG_BLOCK, &mask_all, &prev_mask);
-    int res = _contjob(job_id);
-    Sigprocmask(SIG_SETMASK, &prev_mask, NULL);
-    return res;
-}
-
-int termjob(int job_id) {
-    Sigprocmask(SIG_BLOCK, &mask_all, &prev_mask);
-    int res = _termjob(job_id);
-    Sigprocmask(SIG_SETMASK, &prev_mask, NULL);
-    return res;
-}
-
-int deletejobpid(pid_t pid) {
-    Sigprocmask(SIG_BLOCK, &mask_all, &prev_mask);
-    int res = _deletejobpid(pid);
-    Sigprocmask(SIG_SETMASK, &prev_mask, NULL);
-    return res;
-}
-
-int contjobpid(pid_t pid) {
-    Sigprocmask(SIG_BLOCK, &mask_all, &prev_mask);
-    int res = _contjobpid(pid);
-    Sigprocmask(SIG_SETMASK, &prev_mask, NULL);
-    return res;
+    // Free the jobs that are "Done", now that they have notified the user of their termination
+    Job *job = jobs;
+    while (job != NULL) {
+        Job *older = job->older;
+        if (job->status == S_DONE)
+            removejob(job);
+        job = older;
+    }
 }
 
-int stopjobpid(pid_t pid) {
-    Sigprocmask(SIG_BLOCK, &mask_all, &prev_mask);
-    int res = _stopjobpid(pid);
-    Sigprocmask(SIG_SETMASK, &prev_mask, NULL);
-    return res;
+void waitfgjob() {
+    while (fg != NULL)
+        waitevents();
 }
 
-void freejobs() {
-    Sigprocmask(SIG_BLOCK, &mask_all, &prev_mask);
-    _freejobs();
-    Sigprocmask(SIG_SETMASK, &prev_mask, NULL);
+void waitjobs() {
+    schedjobs();  // The "maxjobs" option may have been raised since the jobs were queued
+    while (nb_running > 0)
+        waitevents();
 }
 
-void killjobs() {
-    Sigprocmask(SIG_BLOCK, &mask_all, &prev_mask);
-    _killjobs();
-    Sigprocmask(SIG_SETMASK, &prev_mask, NULL);
-}
+int waitjob(int job_id) {
+    Job *job = findjob(job_id);
+    if (job == NULL)
+        return -1;  // Job not found
 
-int setfg(int job_id) {
-    Sigprocmask(SIG_BLOCK, &mask_all, &prev_mask);
-    int res = _setfg(job_id);
-    Sigprocmask(SIG_SETMASK, &prev_mask, NULL);
-    return res;
-}
+    // A queued job has no process to watch yet, it is launched as the running jobs terminate
+    // The job is found again after each wait : the foreground job is freed as soon as it is done, even when it holds
+    // the "wait" that waits for it, only its copy remains (see getjobstatus())
+    schedjobs();
+    while ((job = findjob(job_id)) != NULL && job->status == S_QUEUED && nb_running > 0)
+        waitevents();
 
-int getfg() {
-    Sigprocmask(SIG_BLOCK, &mask_all, &prev_mask);
-    int res = _getfg();
-    Sigprocmask(SIG_SETMASK, &prev_mask, NULL);
-    return res;
-}
+    int fds[job != NULL ? job->nb_pids + 1 : 1];
+    while ((job = findjob(job_id)) != NULL && job->status == S_RUNNING) {
+        size_t nb_fds = openpidfds(job, fds);
+        waitfds(fds, nb_fds);
+        closepidfds(fds, nb_fds);
+    }
 
-int getlastjob() {
-    Sigprocmask(SIG_BLOCK, &mask_all, &prev_mask);
-    int res = _getlastjob();
-    Sigprocmask(SIG_SETMASK, &prev_mask, NULL);
-    return res;
+    return getjobstatus(job_id);  // -1 if still queued, without launcher
 }
 
-int getjob(pid_t pid) {
-    Sigprocmask(SIG_BLOCK, &mask_all, &prev_mask);
-    int res = _getjob(pid);
-    Sigprocmask(SIG_SETMASK, &prev_mask, NULL);
-    return res;
-}
+int waitanyjob(int *job_id) {
+    unsigned long done = nb_done;
 
-pid_t getjobpgid(int job_id) {
-    Sigprocmask(SIG_BLOCK, &mask_all, &prev_mask);
-    int res = _getjobpgid(job_id);
-    Sigprocmask(SIG_SETMASK, &prev_mask, NULL);
-    return res;
-}
+    schedjobs();
+    while (nb_done == done && nb_running > 0) {
+        // The running jobs change as queued jobs are launched, the pidfds are opened again each time
+        size_t nb_fds = 0;
+        for (Job *job = jobs; job != NULL; job = job->older)
+            if (job->status == S_RUNNING)
+                nb_fds += job->nb_alive;
+        int *fds = (int *) malloc(sizeof(int) * (nb_fds + 1));
+        nb_fds = 0;
+        for (Job *job = jobs; job != NULL; job = job->older)
+            if (job->status == S_RUNNING)
+                nb_fds += openpidfds(job, fds + nb_fds);
+        waitfds(fds, nb_fds);
+        closepidfds(fds, nb_fds);
+        free(fds);
+    }
 
-char *getjobcmd(int job_id) {
-    Sigprocmask(SIG_BLOCK, &mask_all, &prev_mask);
-    char *res = _getjobcmd(job_id);
-    Sigprocmask(SIG_SETMASK, &prev_mask, NULL);
-    return res;
+    if (nb_done == done)
+        return -1;  // Nothing to wait for
+    *job_id = lastdone;
+    return lastdone_status;
 }
 
-void printjobs() {
-    Sigprocmask(SIG_BLOCK, &mask_all, &prev_mask);
-    _printjobs();
-    Sigprocmask(SIG_SETMASK, &prev_mask, NULL);
-}
+void waitqueue() {
+    // Killed like without any queue, their slots are given to the queued jobs
+    for (Job *job = jobs; job != NULL; job = job->older)
+        if (!job->delayed && (job->status == S_RUNNING || job->status == S_STOPPED))
+            kill(P_PGID(job->pids[0]), SIGKILL);  // Not Kill() : the group may already be gone
 
-void waitfgjob() {
-    while (fg != NULL)
-        sleep(1);
+    for (;;) {
+        schedjobs();
+        // The queued jobs may already have been launched, but not be done yet
+        int delayed = queue_head != NULL;
+        for (Job *job = jobs; job != NULL && !delayed; job = job->older)
+            delayed = job->delayed && job->status == S_RUNNING;
+        if (!delayed || nb_running == 0)
+            return;
+        waitevents();
+    }
 }
@@ -2,15 +2,23 @@
 #define TP_SHELL_SR_2023_JOBS_H
 
 #include <sys/types.h>
+#include <sys/resource.h>
 #include "readcmd.h"
 
-/* initjobs - Initialize the linked list of jobs
+/* None of these functions is reentrant, they must not be called from a signal handler.
+ * Signals are read synchronously through a signalfd by the event loop, see events.h.
+ *
+ * The number of running Jobs is bounded by the "maxjobs" option : background Jobs beyond it are queued (see queuejob())
+ * and launched in FIFO order by the launcher (see setlauncher()) as the running Jobs terminate or are stopped.
+ */
+
+/* initjobs - Initialize the job table
  * Arguments : None
  * Return value : None
  */
 void initjobs(void);
 
-/* addjob - Add a new Job to the linked list of jobs, Signal safe
+/* addjob - Add a new Job to the job table
  * Arguments :
  *  - cmd - The raw command line corresponding to the job
  *  - pids - An array of pids, refer to the struct Job for more information
@@ -19,42 +27,77 @@ void initjobs(void);
  */
 int addjob(char *cmd, pid_t *pids, size_t nb_pids);
 
-/* stopjob - Stop a Job (send SIGTSTP to group process), Signal safe
+/* setlauncher - Set the function launching the queued Jobs
+ * Arguments :
+ *  - launch - The function, called with the command line of a queued Job and its id, it must launch the processes of
+ *             the command line and give them to startjob(), NULL to never launch the queued Jobs
+ * Return value : None
+ */
+void setlauncher(void (*launch)(Cmdline *l, int job_id));
+
+/* mustqueue - Tell whether a new background Job must be queued instead of launched
+ * Arguments : None
+ * Return value : 1 if "maxjobs" Jobs are running, or if Jobs are already queued (they are launched first)
+ *                0 otherwise
+ */
+int mustqueue(void);
+
+/* queuejob - Add a new Job to the job table, in the "Queued" state, waiting for its turn to be launched
+ * Arguments :
+ *  - l - The command line of the Job, it is copied
+ * Return value : The id of the newly created Job
+ */
+int queuejob(Cmdline *l);
+
+/* startjob - Give its processes to a queued Job, which is now running
+ * Arguments :
+ *  - job_id - The id of the queued Job
+ *  - pids - An array of pids, like with addjob(), at most one pid per command of the command line of the Job
+ *  - nb_pids - The number of pids in the array, 0 if nothing could be launched, the Job is then "Done"
+ * Return value : 0 if the Job was started
+ *                1 if the Job was not found, or is not queued
+ */
+int startjob(int job_id, pid_t *pids, size_t nb_pids);
+
+/* stopjob - Stop a Job (send SIGTSTP to group process)
  * Arguments :
  *  - job_id - The id of the Job to stop
  * Return value : 0 if the Job was stopped
  *                1 if the Job was not found
- *                2 if the Job was already stopped or terminated
+ *                2 if the Job was already stopped or terminated, or is queued
  */
 int stopjob(int job_id);
 
-/* contjob - Continue a Job (send SIGCONT to group process), Signal safe
+/* contjob - Continue a Job (send SIGCONT to group process)
  * Arguments :
  *  - job_id - The id of the Job to continue
  * Return value : 0 if the Job was continued
  *                1 if the Job was not found
- *                2 if the Job was already running or terminated
+ *                2 if the Job was already running or terminated, or is queued
  */
 int contjob(int job_id);
 
-/* termjob - Terminate a Job (send SIGTERM to group process), Signal safe
+/* termjob - Terminate a Job (send SIGTERM to group process)
  * Arguments :
  *  - job_id - The id of the Job to terminate
  * Return value : 0 if the Job was terminated
  *                1 if the Job was not found
- *                2 if the Job was already terminated
+ *                2 if the Job was already terminated, or is queued
  */
 int termjob(int job_id);
 
-/* deletejobpid - Delete a pid from a Job (switch it to a "terminated" state), Signal safe
+/* deletejobpid - Delete a pid from a Job (switch it to a "terminated" state)
  * Arguments :
  *  - pid - The pid to delete
+ *  - status - The wait status of the process, the exit status of the Job is the one of its last process (or of its
+ *             last process that failed with the "pipefail" option), or 128 + the signal that killed it
+ *  - usage - The resources used by the process (as given by wait4()), added to those of its Job, may be NULL
  * Return value : 0 if the pid was switched to the "terminated" state
  *                1 if the pid was not found
  */
-int deletejobpid(pid_t pid);
+int deletejobpid(pid_t pid, int status, struct rusage *usage);
 
-/* contjobpid - Continue a Job, Signal safe
+/* contjobpid - Continue a Job
  * Arguments :
  *  - pid - The pid of the Job to continue, only effective if the pid is the pid of the leader process
  * Return value : 0 if the Job was continued
@@ -62,7 +105,7 @@ int deletejobpid(pid_t pid);
  */
 int contjobpid(pid_t pid);
 
-/* stopjobpid - Stop a Job, Signal safe
+/* stopjobpid - Stop a Job
  * Arguments :
  *  - pid - The pid of the Job to stop, only effective if the pid is the pid of the leader process
  * Return value : 0 if the Job was stopped
@@ -70,42 +113,43 @@ int contjobpid(pid_t pid);
  */
 int stopjobpid(pid_t pid);
 
-/* freejobs - Free all the Jobs, Signal safe
+/* freejobs - Free all the Jobs
  * Arguments : None
  * Return value : None
  */
 void freejobs(void);
 
-/* killjobs - Kill all the Jobs (send SIGKILL to all group processes) and free them, Signal safe
+/* killjobs - Kill all the Jobs (send SIGKILL to all group processes) and free them
  * Arguments : None
  * Return value : None
  */
 void killjobs(void);
 
-/* setfg - Set a Job as the foreground Job, Signal safe
+/* setfg - Set a Job as the foreground Job
  * Arguments :
  *  - job_id - The id of the Job to set as the foreground Job
  * Return value : 0 if the Job was set as the foreground Job
  *                1 if the Job was not found
  *                2 if a Job was already in foreground
+ * Notes : A queued Job is launched right away, regardless of the "maxjobs" option
  */
 int setfg(int job_id);
 
-/* getfg - Get the id of the foreground Job, Signal safe
+/* getfg - Get the id of the foreground Job
  * Arguments : None
  * Return value : The id of the foreground Job
  *                -1 if no Job is in foreground
  */
 int getfg(void);
 
-/* getlastjob - Get the id of the lastly created Job, Signal safe
+/* getlastjob - Get the id of the lastly created Job
  * Arguments : None
  * Return value : The id of the last Job
  *                -1 if no Job exists
  */
 int getlastjob(void);
 
-/* getjob - Get the id of a Job, Signal safe
+/* getjob - Get the id of a Job
  * Arguments :
  *  - pid - The pid of the Job to get the id
  * Return value : The id of the Job
@@ -113,15 +157,15 @@ int getlastjob(void);
  */
 int getjob(pid_t pid);
 
-/* getjobpgid - Get the pgid of a Job (that is the pid of the process leader), Signal safe
+/* getjobpgid - Get the pgid of a Job (that is the pid of the process leader)
  * Arguments :
  *  - job_id - The id of the Job to get the pgid from
  * Return value : The pgid of the Job
- *                -1 if the Job was not found
+ *                -1 if the Job was not found, or has no process (queued)
  */
 pid_t getjobpgid(int job_id);
 
-/* getjobcmd - Get the command line of a Job, Signal safe
+/* getjobcmd - Get the command line of a Job
  * Arguments :
  *  - job_id - The id of the Job to get the command line from
  * Return value : The raw command line of the Job
@@ -129,17 +173,102 @@ pid_t getjobpgid(int job_id);
  */
 char *getjobcmd(int job_id);
 
-/* printjobs - Print all the Jobs (like the "jobs" command), Signal safe
+/* getjobusage - Get the time and the resources used by a Job
+ * Arguments :
+ *  - job_id - The id of the Job, it may also be the last Job that left the foreground, even if it was freed since
+ *  - real - Filled with the wall clock time during which the Job was running, in nanoseconds
+ *  - usage - Filled with the resources used by the processes of the Job
+ * Return value : 0 if the Job was found
+ *                1 if the Job was not found
+ * Notes : Only the processes that terminated are accounted for in usage, the kernel gives nothing before.
+ *         The kernel also accounts to a process the max RSS of the memory it had before execve(). With the "spawn"
+ *         option, posix_spawn() children share the memory of the shell until then, so their max RSS is never below
+ *         the max RSS of the shell, only a process using more memory than the shell gets its own
+ */
+int getjobusage(int job_id, long long *real, struct rusage *usage);
+
+/* getjobstatus - Get the exit status of a Job
+ * Arguments :
+ *  - job_id - The id of the Job, like with getjobusage()
+ * Return value : The exit status of the Job (see deletejobpid()), 128 + SIGTSTP if it is stopped
+ *                -1 if the Job was not found, or is not finished
+ */
+int getjobstatus(int job_id);
+
+/* setshellstatus - Record the exit status of a command of a Job that is not one of its processes (an internal command
+ *                  executed by the shell itself, or a command that could not be launched)
+ * Arguments :
+ *  - job_id - The id of the Job, it may also be the last Job that left the foreground, like with getjobusage()
+ *  - before - The number of processes of the Job launched before the command
+ *  - last - 1 if the command is the last one of the command line of the Job, 0 otherwise
+ *  - status - The exit status of the command
+ * Return value : 0 if the status was recorded
+ *                1 if the Job was not found
+ * Notes : Must be called in the order of the commands. The exit status of the Job accounts for it like for the one of
+ *         a process, with the "pipefail" option as well (see deletejobpid()), even if the Job is already "Done"
+ */
+int setshellstatus(int job_id, size_t before, int last, int status);
+
+/* getstageusage - Get the time and the resources used by one process of a Job
+ * Arguments :
+ *  - job_id - The id of the Job, like with getjobusage()
+ *  - i - The index of the process in the Job, in the order of the pids given to addjob()
+ *  - pid - Filled with the pid of the process
+ *  - real - Filled with the wall clock time during which the Job was running until the process terminated (or until
+ *           now if it did not), in nanoseconds
+ *  - usage - Filled with the resources used by the process, zeroed while it did not terminate
+ * Return value : 0 if the process was found
+ *                1 if the Job was not found, or if it has less than i + 1 processes
+ */
+int getstageusage(int job_id, size_t i, pid_t *pid, long long *real, struct rusage *usage);
+
+/* printjobs - Print all the Jobs (like the "jobs" command), but the foreground Job
  *              Also frees the Jobs that are "Done"
- * Arguments : None
+ * Arguments :
+ *  - verbose - 1 to also print the resources used by each Job (like "jobs -l"), 0 otherwise
  * Return value : None
  */
-void printjobs(void);
+void printjobs(int verbose);
 
-/* waitfgjob - Wait for the foreground Job to finish
+/* waitfgjob - Wait for the foreground Job to finish (or to be stopped)
  * Arguments : None
  * Return value : None
+ * Notes : Sleeps in waitevents(), so it wakes up as soon as the state of the foreground Job changed
  */
 void waitfgjob(void);
 
+/* waitjobs - Wait for every running Job to finish (or to be stopped), launching the queued Jobs meanwhile
+ * Arguments : None
+ * Return value : None
+ * Notes : Returns once the queue is drained, the "Done" Jobs are still notified by printjobs()
+ */
+void waitjobs(void);
+
+/* waitjob - Wait for a Job to finish (or to be stopped)
+ * Arguments :
+ *  - job_id - The id of the Job, it may be queued, running, stopped or done
+ * Return value : The exit status of the Job, 128 + SIGTSTP if it is stopped
+ *                -1 if the Job was not found, or if it is queued and cannot be launched
+ * Notes : Sleeps on pidfds of the processes of the Job, so it wakes up as soon as one of them terminates
+ */
+int waitjob(int job_id);
+
+/* waitanyjob - Wait for any running or queued Job to finish
+ * Arguments :
+ *  - job_id - Filled with the id of the Job that finished
+ * Return value : The exit status of the Job
+ *                -1 if there was no running nor queued Job to wait for
+ * Notes : Sleeps on pidfds of the processes of every running Job, like waitjob()
+ */
+int waitanyjob(int *job_id);
+
+/* waitqueue - Wait for the Jobs that were queued to finish (or to be stopped), after killing the other ones
+ * Arguments : None
+ * Return value : None
+ * Notes : Used at the end of the input, before killjobs(). The rule does not depend on the other Jobs : a Job launched
+ *         when it was created is killed, as without the "maxjobs" option, and a Job that the scheduler delayed runs
+ *         until it is done, even if it was launched before the end of the input
+ */
+void waitqueue(void);
+
 #endif //TP_SHELL_SR_2023_JOBS_H
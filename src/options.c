@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "options.h"
+
+typedef struct _option {
+    char *name;  // Name used by setopt
+    long value;  // Current value
+    long min;    // Lowest accepted value
+    long max;    // Highest accepted value
+} Option;
+
+// Indexed by the OPT_* constants
+static Option options[NB_OPTIONS] = {
+        [OPT_SPAWN] = {"spawn", 1, 0, 1},
+        [OPT_MAXJOBS] = {"maxjobs", 0, 0, INT_MAX},
+        [OPT_PIPEFAIL] = {"pipefail", 0, 0, 1},
+        [OPT_PIPESIZE] = {"pipesize", 0, 0, 1 << 30},
+};
+
+long getoption(int opt) {
+    return options[opt].value;
+}
+
+int setoption(char *assignment) {
+    char *eq = strchr(assignment, '=');
+    if (eq == NULL)
+        return 2;  // No value given
+
+    for (int i = 0; i < NB_OPTIONS; i++) {
+        if (strncmp(options[i].name, assignment, eq - assignment) != 0 || options[i].name[eq - assignment] != 0)
+            continue;
+
+        char *end, *units = "KMG";
+        long value = strtol(eq + 1, &end, 10);
+        char *unit = (end != eq + 1 && *end != 0 && end[1] == 0) ? strchr(units, *end) : NULL;
+        if (unit != NULL && value >= 0 && value <= (1L << 30)) {
+            value <<= 10 * (unit - units + 1);  // Binary multiple, small enough not to overflow
+            end++;
+        }
+        if (end == eq + 1 || *end != 0 || value < options[i].min || value > options[i].max)
+            return 2;  // Not a number, or out of bounds
+        options[i].value = value;
+        return 0;
+    }
+    return 1;  // Option not found
+}
+
+void printoptions() {
+    for (int i = 0; i < NB_OPTIONS; i++)
+        printf("%s=%ld\n", options[i].name, options[i].value);
+}
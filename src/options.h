@@ -0,0 +1,34 @@
+#ifndef TP_SHELL_SR_2023_OPTIONS_H
+#define TP_SHELL_SR_2023_OPTIONS_H
+
+/* Shell options, changed with the "setopt name=value" internal command */
+#define OPT_SPAWN 0    // 1 to launch external commands with posix_spawn(), 0 to always fork()
+#define OPT_MAXJOBS 1  // Maximum number of running Jobs before background Jobs are queued, 0 for the number of processors
+#define OPT_PIPEFAIL 2 // 1 for the exit status of a pipeline to be the one of its last command that failed
+#define OPT_PIPESIZE 3 // Capacity of the tubes between the commands of a pipeline in bytes, 0 for the default of the kernel
+#define NB_OPTIONS 4
+
+/* getoption - Get the value of an option
+ * Arguments :
+ *  - opt - The option (one of the OPT_* constants)
+ * Return value : The current value of the option
+ */
+long getoption(int opt);
+
+/* setoption - Set an option from a "name=value" string
+ * Arguments :
+ *  - assignment - The "name=value" string, the value may end with "K", "M" or "G" to be multiplied by 1024, 1024^2 or
+ *                 1024^3
+ * Return value : 0 if the option was set
+ *                1 if the option does not exist
+ *                2 if the value is invalid
+ */
+int setoption(char *assignment);
+
+/* printoptions - Print all the options and their values (like the "setopt" command)
+ * Arguments : None
+ * Return value : None
+ */
+void printoptions(void);
+
+#endif //TP_SHELL_SR_2023_OPTIONS_H
@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "prompt.h"
+#include "csapp.h"
+
+// La vie est plus belle avec des couleurs
+#define GREEN "\e[1;32m"
+#define BLUE "\e[1;34m"
+#define RESET "\e[0m"
+
+#define HOST_MAX 256   // 255 is the max length of a hostname
+#define USER_MAX 256
+
+// "user@hostname:" part, rendered once by initprompt()
+static char prefix[sizeof(GREEN) + USER_MAX + HOST_MAX + sizeof(RESET) + 1];
+static size_t prefix_len;
+
+// Whole prompt, rendered again by setpromptcwd() only
+static char prompt[sizeof(prefix) + sizeof(BLUE) + PATH_MAX + sizeof(RESET) + 2];
+static size_t prompt_len;
+
+static char home[PATH_MAX];
+static size_t home_len;
+
+
+void initprompt(void) {
+    char hostname[HOST_MAX] = "";
+    char *user = getenv("USER");
+    char *h = getenv("HOME");
+
+    gethostname(hostname, HOST_MAX - 1);
+    prefix_len = snprintf(prefix, sizeof(prefix), "%s%.*s@%s%s:", GREEN, USER_MAX - 1, user ? user : "",
+                          hostname, RESET);
+
+    // A trailing '/' would prevent HOME from matching the current directory
+    home_len = 0;
+    if (h != NULL && strlen(h) < PATH_MAX) {
+        strcpy(home, h);
+        home_len = strlen(home);
+        while (home_len > 1 && home[home_len - 1] == '/')
+            home[--home_len] = 0;
+    }
+
+    char cwd[PATH_MAX];
+    setpromptcwd(getcwd(cwd, PATH_MAX));
+}
+
+void setpromptcwd(char *cwd) {
+    char *p = prompt + prefix_len;
+    memcpy(prompt, prefix, prefix_len);
+
+    memcpy(p, BLUE, sizeof(BLUE) - 1);
+    p += sizeof(BLUE) - 1;
+
+    // Display "~" instead of the home path, only when it is a whole component of the current directory
+    if (cwd == NULL)
+        cwd = "?";
+    else if (home_len > 0 && strncmp(cwd, home, home_len) == 0 && (cwd[home_len] == '/' || cwd[home_len] == 0)) {
+        *p++ = '~';
+        cwd += home_len;
+    }
+    size_t len = strlen(cwd);
+    if (len > PATH_MAX - 1)
+        len = PATH_MAX - 1;
+    memcpy(p, cwd, len);
+    p += len;
+
+    memcpy(p, RESET "$ ", sizeof(RESET "$ ") - 1);
+    p += sizeof(RESET "$ ") - 1;
+    prompt_len = p - prompt;
+}
+
+void show_prompt(void) {
+    fflush(stdout);  // Anything printed by the previous command must come before the prompt
+    rio_writen(STDOUT_FILENO, prompt, prompt_len);  // Errors are ignored, like with printf()
+}
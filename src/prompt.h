@@ -0,0 +1,26 @@
+#ifndef TP_SHELL_SR_2023_PROMPT_H
+#define TP_SHELL_SR_2023_PROMPT_H
+
+/* initprompt - Capture the user, the hostname, the home and the current directory, and render the prompt
+ * Arguments : None
+ * Return value : None
+ * Notes : Must be called once before show_prompt(), the environment is not read again afterwards
+ */
+void initprompt(void);
+
+/* setpromptcwd - Render the prompt again with a new current directory
+ * Arguments :
+ *  - cwd - The new current directory (an absolute path), or NULL if it could not be determined
+ * Return value : None
+ * Notes : Called by the cd command, the current directory is never queried by show_prompt()
+ */
+void setpromptcwd(char *cwd);
+
+/* show_prompt - Prints the command prompt in standard output, with nice colors and stuff :)
+ * Arguments : None
+ * Return value : None
+ * Notes : The prompt is rendered in advance, showing it costs a single write()
+ */
+void show_prompt(void);
+
+#endif //TP_SHELL_SR_2023_PROMPT_H
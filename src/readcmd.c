@@ -8,7 +8,9 @@
 #include <errno.h>
 #include <limits.h>
 #include <string.h>
+#include <unistd.h>
 #include "readcmd.h"
+#include "stats.h"
 
 
 static void memory_error(void) {
@@ -32,319 +34,616 @@ static void *xrealloc(void *ptr, size_t size) {
 }
 
 
-/* Read a line from standard input and put it in a char[] */
+#define INBUF_SIZE 65536  // Initial size of the input buffer
+
+/* Input buffer, kept from one line to the next : bytes [in_start, in_end[ have been read but not returned yet, and
+bytes [in_start, in_scan[ are known not to contain any '\n' */
+static char *inbuf = 0;
+static size_t inbuf_cap = 0;
+static size_t in_start = 0, in_scan = 0, in_end = 0;
+static int in_eof = 0;
+
+
+/* Read a line from standard input, without its '\n'. The line lives in the input buffer until the next call. */
 static char *readline(void) {
-    size_t buf_len = 16;
-    char *buf = xmalloc(buf_len * sizeof(char));
+    char *line, *nl;
+    ssize_t n;
 
-    if (fgets(buf, buf_len, stdin) == NULL) {
-        free(buf);
-        return NULL;
+    if (!inbuf) {
+        inbuf_cap = INBUF_SIZE;
+        inbuf = xmalloc(inbuf_cap);
     }
 
-    if (feof(stdin)) { /* End of file (ctrl-d) */
-        fflush(stdout);
-        exit(0);
-    }
+    while (1) {
+        /* Only the bytes read since the last search are scanned */
+        if ((nl = memchr(inbuf + in_scan, '\n', in_end - in_scan)) != NULL) {
+            *nl = 0;
+            line = inbuf + in_start;
+            in_start = in_scan = nl - inbuf + 1;
+            return line;
+        }
+        in_scan = in_end;
+
+        if (in_eof) { /* End of file (ctrl-d), the last line may lack its '\n' */
+            if (in_start == in_end) return NULL;
+            inbuf[in_end] = 0;
+            line = inbuf + in_start;
+            in_start = in_scan = in_end;
+            return line;
+        }
 
-    do {
-        size_t l = strlen(buf);
-        if ((l > 0) && (buf[l - 1] == '\n')) {
-            l--;
-            buf[l] = 0;
-            return buf;
+        /* Make room for more bytes : move the beginning of the line to the front, or grow the buffer */
+        if (in_start > 0) {
+            memmove(inbuf, inbuf + in_start, in_end - in_start);
+            in_end -= in_start;
+            in_scan -= in_start;
+            in_start = 0;
         }
-        if (buf_len >= (INT_MAX / 2)) memory_error();
-        buf_len *= 2;
-        buf = xrealloc(buf, buf_len * sizeof(char));
-        if (fgets(buf + l, buf_len - l, stdin) == NULL) return buf;
-    } while (1);
+        if (in_end + 1 >= inbuf_cap) {
+            if (inbuf_cap >= (INT_MAX / 2)) memory_error();
+            inbuf_cap *= 2;
+            inbuf = xrealloc(inbuf, inbuf_cap);
+        }
+
+        n = read(0, inbuf + in_end, inbuf_cap - in_end - 1); /* Keep room for the final null character */
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0)
+            in_eof = 1;
+        else
+            in_end += n;
+    }
 }
 
 
-/* Split the string in words, according to the simple shell grammar. */
-static char **split_in_words(char *line) {
-    char *cur = line;
-    char **tab = 0;
-    size_t l = 0;
-    char c;
-    int escape = 0;
-
-    while ((c = *cur) != 0) {
-        char *w = 0;
-        char *start;
-        switch (c) {
-            case ' ':
-            case '\t':
-                /* Ignore any whitespace */
-                cur++;
-                break;
-            case '<':
-                w = "<";
-                cur++;
-                break;
-            case '>':
-                w = ">";
-                cur++;
-                break;
-            case '|':
-                w = "|";
-                cur++;
-                break;
-            case '&':
-                w = "&";
-                cur++;
-                break;
-            case '\'':
-                escape = 1;
-            case '"':
-                start = ++cur;
-                // While current char is not null, and not end of quote
-                int escaped_c = 0;
-                while ((c = *cur) && (c != start[-1] || escaped_c)) {
-                    cur++;
-                    // if current char is backslash and escape is disabled and current char is not escaped
-                    if (c == '\\' && !escape && !escaped_c)
-                        escaped_c = 1;
-                    else
-                        escaped_c = 0;
-                }
-                if (c == 0) {
-                    errno = EINVAL;
-                    perror(0);
-                }
-                w = xmalloc((cur - start + 1) * sizeof(char));
-                strncpy(w, start, cur - start);
-                w[cur - start] = 0;
-                cur++;
-                escape = 0;
-                break;
-            default:
-                /* Another word */
-                start = cur;
-                while (c) {
-                    c = *cur++;
-                    switch (c) {
-                        case 0:
-                        case ' ':
-                        case '\t':
-                        case '<':
-                        case '>':
-                        case '|':
-                        case '&':
-                            c = 0;
-                            break;
-                        case '\\':
-                            cur++;
-                        default:;
-                    }
-                }
-                cur--;
-                w = xmalloc((cur - start + 1) * sizeof(char));
-                strncpy(w, start, cur - start);
-                w[cur - start] = 0;
-        }
-        if (w) {
-            tab = xrealloc(tab, (l + 1) * sizeof(char *));
-            tab[l++] = w;
-        }
+int inputpending(void) {
+    if (!inbuf) return 0;
+    return in_eof || memchr(inbuf + in_scan, '\n', in_end - in_scan) != NULL;
+}
+
+
+/* Tokens of the simple shell grammar */
+#define T_ERROR -1  // Unterminated quote
+#define T_END 0     // End of the line
+#define T_WORD 1    // A word, quotes and escaping backslashes removed
+#define T_IN 2      // "<"
+#define T_OUT 3     // ">"
+#define T_PIPE 4    // "|"
+#define T_BG 5      // "&"
+#define T_SEMI 6    // ";"
+#define T_AND 7     // "&&"
+#define T_OR 8      // "||"
+#define T_APPEND 9  // ">>"
+#define T_HERE 10   // "<<<"
+#define T_ERR 11    // "2>"
+#define T_ERRAPP 12 // "2>>"
+#define T_ERRDUP 13 // "2>&1"
+#define T_OUTERR 14 // "&>"
+
+#define ARENA_CHUNK 4096  // Size of the first chunk of the arena
+
+#define VAR_STATUS '\001'  // Stands for "$?" in the words, until expandcmd() replaces it
+
+/* Set by next_token() when the word contains VAR_STATUS */
+static int has_vars = 0;
+
+/* Chunk of memory of the arena */
+typedef struct _chunk {
+    struct _chunk *prev;  // Previous (smaller) chunk
+    size_t size;          // Size of data
+    size_t used;          // Number of bytes of data given away
+    char data[];
+} Chunk;
+
+/* Bump allocator : everything a command line needs is allocated in it, and freed at once by the next readcmd() */
+static Chunk *arena = 0;
+
+/* Arrays reused from one line to the next to collect the words of a command and the commands of a sequence,
+before they are copied to the arena with their exact size */
+static char **words = 0;
+static size_t words_cap = 0;
+static char ***cmds = 0;
+static size_t cmds_cap = 0;
+
+
+/* Allocate memory in the arena, that stays valid until the next call to areset() */
+static void *aalloc(size_t size) {
+    size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+    if (!arena || arena->used + size > arena->size) {
+        size_t chunk_size = arena ? 2 * arena->size : ARENA_CHUNK;
+        while (chunk_size < size) chunk_size *= 2;
+        Chunk *c = xmalloc(sizeof(Chunk) + chunk_size);
+        c->prev = arena;
+        c->size = chunk_size;
+        c->used = 0;
+        arena = c;
     }
-    tab = xrealloc(tab, (l + 1) * sizeof(char *));
-    tab[l++] = 0;
-    return tab;
+    void *p = arena->data + arena->used;
+    arena->used += size;
+    return p;
 }
 
 
-static void freeseq(char ***seq) {
-    int i, j;
+/* Give back everything allocated in the arena, only the biggest chunk is kept for the next line */
+static void areset(void) {
+    if (!arena) return;
+    Chunk *c = arena->prev;
+    while (c) {
+        Chunk *prev = c->prev;
+        free(c);
+        c = prev;
+    }
+    arena->prev = 0;
+    arena->used = 0;
+}
 
-    for (i = 0; seq[i] != 0; i++) {
-        char **cmd = seq[i];
 
-        for (j = 0; cmd[j] != 0; j++) free(cmd[j]);
-        free(cmd);
+/* Append an element to one of the reusable arrays, doubling its capacity when full */
+static void *push(void *tab, size_t *cap, size_t len, size_t elt_size) {
+    if (len == *cap) {
+        *cap = *cap ? 2 * *cap : 16;
+        tab = xrealloc(tab, *cap * elt_size);
     }
-    free(seq);
+    return tab;
 }
 
 
-/* Free the fields of the structure but not the structure itself */
-static void freecmd(struct cmdline *s) {
-    if (s->in) free(s->in);
-    if (s->out) free(s->out);
-    if (s->seq) freeseq(s->seq);
-    if (s->raw) free(s->raw);
+/* Copy the first len pointers of a reusable array to the arena, followed by a null pointer */
+static void *acopy(void *tab, size_t len) {
+    void **copy = aalloc((len + 1) * sizeof(void *));
+    memcpy(copy, tab, len * sizeof(void *));
+    copy[len] = 0;
+    return copy;
 }
 
-void freecmd2(struct cmdline *s) {
-    if (!s)
-        return;
-    if (s->err) free(s->err);
-    freecmd(s);
-    free(s);
+
+/* Tell whether a character ends an unquoted word */
+static int is_separator(char c) {
+    switch (c) {
+        case 0:
+        case ' ':
+        case '\t':
+        case '<':
+        case '>':
+        case '|':
+        case '&':
+        case ';':
+            return 1;
+        default:
+            return 0;
+    }
 }
 
 
-struct cmdline *readcmd(void) {
-    static struct cmdline *static_cmdline = 0;
-    struct cmdline *s = static_cmdline;
-    char *line;
-    char **words;
-    int i;
-    char *w;
-    char **cmd;
-    char ***seq;
-    size_t cmd_len, seq_len;
-
-    line = readline();
-    if (line == NULL) {
-        if (s) {
-            freecmd(s);
-            free(s);
+/* Read the next token of the line, according to the simple shell grammar. *cur is moved after the token, and the
+word is copied to the arena (without its quotes and escaping backslashes) if the token is T_WORD. */
+static int next_token(char **cur, char **word) {
+    char *c = *cur;
+    char quote = 0;
+
+    /* Ignore any whitespace */
+    while (*c == ' ' || *c == '\t') c++;
+
+    *cur = c + 1;
+    switch (*c) {
+        case 0:
+            *cur = c;
+            return T_END;
+        case '<':
+            if (c[1] == '<' && c[2] == '<') {
+                *cur = c + 3;
+                return T_HERE;
+            }
+            return T_IN;
+        case '>':
+            if (c[1] == '>') {
+                *cur = c + 2;
+                return T_APPEND;
+            }
+            return T_OUT;
+        case '2': /* Only at the start of a word : "a2>b" is the word "a2" written to "b" */
+            if (c[1] != '>')
+                break;
+            if (c[2] == '&' && c[3] == '1' && is_separator(c[4])) {
+                *cur = c + 4;
+                return T_ERRDUP;
+            }
+            *cur = c + (c[2] == '>' ? 3 : 2);
+            return (c[2] == '>') ? T_ERRAPP : T_ERR;
+        case '|':
+            if (c[1] == '|') {
+                *cur = c + 2;
+                return T_OR;
+            }
+            return T_PIPE;
+        case '&':
+            if (c[1] == '&') {
+                *cur = c + 2;
+                return T_AND;
+            }
+            if (c[1] == '>') {
+                *cur = c + 2;
+                return T_OUTERR;
+            }
+            return T_BG;
+        case ';':
+            return T_SEMI;
+    }
+
+    /* Another word : find its end first, the word is at most as long as its raw text */
+    char *end = c;
+    int plain = 1; /* No quote nor backslash in the word */
+    while (1) {
+        if (!quote)
+            end += strcspn(end, " \t<>|&;'\"\\$"); /* Skip the ordinary characters at once */
+        if (!*end || (!quote && is_separator(*end)))
+            break;
+        plain = 0;
+        if (quote) {
+            if (*end == quote)
+                quote = 0;
+            else if (quote == '"' && *end == '\\' && end[1])
+                end++;
+        } else if (*end == '\'' || *end == '"')
+            quote = *end;
+        else if (*end == '\\' && end[1])
+            end++;
+        end++;
+    }
+    if (quote)
+        return T_ERROR;
+    *cur = end;
+
+    /* Then copy it, removing the quotes and the escaping backslashes */
+    char *w = *word = aalloc(end - c + 1);
+    if (plain) {
+        memcpy(w, c, end - c);
+        w[end - c] = 0;
+        return T_WORD;
+    }
+    while (c < end) {
+        if (*c == '$' && c + 1 < end && c[1] == '?' && quote != '\'') { /* Expanded before the execution */
+            *w++ = VAR_STATUS;
+            has_vars = 1;
+            c += 2;
+            continue;
         }
-        return static_cmdline = 0;
+        if (quote) {
+            if (*c == quote)
+                quote = 0;
+            else if (quote == '"' && *c == '\\' && strchr("\"\\$`", c[1]))
+                *w++ = *++c;
+            else
+                *w++ = *c;
+        } else if (*c == '\'' || *c == '"')
+            quote = *c;
+        else if (*c == '\\' && c + 1 < end)
+            *w++ = *++c;
+        else
+            *w++ = *c;
+        c++;
     }
+    *w = 0;
+    return T_WORD;
+}
+
 
-    cmd = xmalloc(sizeof(char *));
-    cmd[0] = 0;
-    cmd_len = 0;
-    seq = xmalloc(sizeof(char **));
-    seq[0] = 0;
-    seq_len = 0;
+void freecmds(void) {
+    areset();
+    free(arena);
+    arena = 0;
+    free(words);
+    words = 0;
+    words_cap = 0;
+    free(cmds);
+    cmds = 0;
+    cmds_cap = 0;
+    free(inbuf);
+    inbuf = 0;
+    inbuf_cap = 0;
+    in_start = in_scan = in_end = 0;
+}
 
-    words = split_in_words(line);
 
-    if (!s)
-        static_cmdline = s = xmalloc(sizeof(struct cmdline));
-    else
-        freecmd(s);
+/* Parse the pipeline of a line starting at *cur, up to the end of the line or to the operator ending it, *cur is moved
+after this operator. The line must stay valid as long as the result is used, the result is allocated in the arena. */
+static struct cmdline *parsepipeline(char *line, char **cur) {
+    struct cmdline *s = aalloc(sizeof(struct cmdline));
+    char *start, *end, *w;
+    size_t cmd_len = 0, seq_len = 0;
+    int t;
+
     s->bg = 0;
+    s->time = 0;
+    s->expand = 0;
     s->err = 0;
     s->in = 0;
     s->out = 0;
+    s->here = 0;
+    s->append = 0;
+    s->errout = 0;
+    s->errappend = 0;
+    s->errdup = 0;
+    s->errcmd = 0;
     s->seq = 0;
-    s->raw = line;
-
-    int k;
-    size_t len;
-
-    i = 0;
-    while ((w = words[i++]) != 0) {
-        switch (w[0]) {
-            case '<':
-                /* Tricky : the word can only be "<" */
-                if (s->in) {
+    s->raw = 0;
+    s->op = L_SEQ;
+    s->next = 0;
+
+    start = *cur += strspn(*cur, " \t");
+    while (1) {
+        end = *cur;
+        t = next_token(cur, &w);
+        if (t == T_END || t == T_SEMI || t == T_AND || t == T_OR || t == T_BG)
+            break;
+        switch (t) {
+            case T_ERROR:
+                s->err = "unterminated quote";
+                goto error;
+            case T_IN:
+            case T_HERE:
+                if (s->in || s->here) {
                     s->err = "only one input file supported";
                     goto error;
                 }
-                if (words[i] == 0) {
-                    s->err = "filename missing for input redirection";
+                if (next_token(cur, (t == T_IN) ? &s->in : &s->here) != T_WORD) {
+                    s->err = (t == T_IN) ? "filename missing for input redirection" : "word missing for here-string";
                     goto error;
                 }
-                s->in = words[i++];
                 break;
-            case '>':
-                /* Tricky : the word can only be ">" */
+            case T_OUT:
+            case T_APPEND:
+            case T_OUTERR:
                 if (s->out) {
                     s->err = "only one output file supported";
                     goto error;
                 }
-                if (words[i] == 0) {
+                if (t == T_OUTERR && (s->errout || s->errdup)) {
+                    s->err = "only one error file supported";
+                    goto error;
+                }
+                if (next_token(cur, &s->out) != T_WORD) {
                     s->err = "filename missing for output redirection";
                     goto error;
                 }
-                s->out = words[i++];
+                s->append = (t == T_APPEND);
+                if (t == T_OUTERR) {
+                    s->errdup = 1;
+                    s->errcmd = seq_len;
+                }
                 break;
-            case '|':
-                /* Tricky : the word can only be "|" */
-                if (cmd_len == 0) {
-                    s->err = "misplaced pipe";
+            case T_ERR:
+            case T_ERRAPP:
+            case T_ERRDUP:
+                if (s->errout || s->errdup) {
+                    s->err = "only one error file supported";
                     goto error;
                 }
-
-                seq = xrealloc(seq, (seq_len + 2) * sizeof(char **));
-                seq[seq_len++] = cmd;
-                seq[seq_len] = 0;
-
-                cmd = xmalloc(sizeof(char *));
-                cmd[0] = 0;
-                cmd_len = 0;
-                break;
-            case '&':
-                /* Tricky : the word can only be "&" */
-                // Background operator should be the last word, otherwise it was misplaced
-                if (words[i] != 0 || w[1] != 0) {
-                    // If the next character is '&' then the user tried to use '&&', which is not supported
-                    if (strcmp(words[i], "&") == 0)
-                        s->err = "only one background operator supported";
-                    else
-                        s->err = "misplaced background operator";
+                if (t == T_ERRDUP)
+                    s->errdup = s->out ? 1 : 2;  // Like sh, "2>&1 > file" keeps the previous standard output
+                else if (next_token(cur, &s->errout) != T_WORD) {
+                    s->err = "filename missing for error redirection";
                     goto error;
                 }
-                // There should be only one background operator
-                if (s->bg) {
-                    s->err = "only one background operator supported";
+                s->errappend = (t == T_ERRAPP);
+                s->errcmd = seq_len;
+                break;
+            case T_PIPE:
+                if (cmd_len == 0) {
+                    s->err = "misplaced pipe";
                     goto error;
                 }
-                s->bg = 1;
+                cmds = push(cmds, &cmds_cap, seq_len, sizeof(char **));
+                cmds[seq_len++] = acopy(words, cmd_len);
+                cmd_len = 0;
                 break;
+            case T_WORD:
             default:
-                // Change the word to delete the escaping backslashes
-                k = 0;
-                len = strlen(w);
-                for (int j = 0; j < len; j++) {
-                    if (w[k + j] == '\\')
-                        w[j] = w[++k + j];
-                    else
-                        w[j] = w[k + j];
+                // "time" is a keyword only in front of the whole pipeline, "-v" right after it asks for details
+                if (!s->time && cmd_len == 0 && seq_len == 0 && !s->in && !s->out && strcmp(w, "time") == 0) {
+                    s->time = 1;
+                    break;
                 }
-                w[len - k] = 0;
-                cmd = xrealloc(cmd, (cmd_len + 2) * sizeof(char *));
-                cmd[cmd_len++] = w;
-                cmd[cmd_len] = 0;
+                if (s->time == 1 && cmd_len == 0 && seq_len == 0 && !s->in && !s->out && strcmp(w, "-v") == 0) {
+                    s->time = 2;
+                    break;
+                }
+                words = push(words, &words_cap, cmd_len, sizeof(char *));
+                words[cmd_len++] = w;
         }
     }
 
     if (cmd_len != 0) {
-        seq = xrealloc(seq, (seq_len + 2) * sizeof(char **));
-        seq[seq_len++] = cmd;
-        seq[seq_len] = 0;
+        cmds = push(cmds, &cmds_cap, seq_len, sizeof(char **));
+        cmds[seq_len++] = acopy(words, cmd_len);
     } else if (seq_len != 0) {
         s->err = "misplaced pipe";
-        i--;
         goto error;
-    } else
-        free(cmd);
-    free(words);
-    s->seq = seq;
+    } else if (t != T_END) {
+        // Only an empty line has no command at all
+        s->err = (t == T_BG) ? "misplaced background operator" : "misplaced command separator";
+        goto error;
+    }
+
+    switch (t) {
+        case T_BG:
+            s->bg = 1;
+            end = *cur;  // The '&' is shown with the job
+            break;
+        case T_AND:
+        case T_OR:
+            // Another pipeline must follow
+            if (!(*cur)[strspn(*cur, " \t")]) {
+                s->err = "misplaced command separator";
+                goto error;
+            }
+            s->op = (t == T_AND) ? L_AND : L_OR;
+            break;
+    }
+
+    // The raw text of a pipeline alone on its line is the line itself, otherwise it is copied without the separator
+    if (start == line && t == T_END)
+        s->raw = line;
+    else {
+        while (end > start && (end[-1] == ' ' || end[-1] == '\t')) end--;
+        s->raw = aalloc(end - start + 1);
+        memcpy(s->raw, start, end - start);
+        s->raw[end - start] = 0;
+    }
+    s->seq = acopy(cmds, seq_len);
+    s->expand = has_vars;
+    has_vars = 0;
     return s;
+
     error:
-    while ((w = words[i++]) != 0) {
-        switch (w[0]) {
-            case '<':
-            case '>':
-            case '|':
-            case '&':
-                break;
-            default:
-                free(w);
+    has_vars = 0;
+    s->in = 0;
+    s->out = 0;
+    s->here = 0;
+    s->errout = 0;
+    s->errdup = 0;
+    s->raw = 0;
+    return s;
+}
+
+
+/* Parse a line (that must stay valid as long as the result is used) into a list of pipelines, or into a single
+command line holding the error of the first pipeline that has one. The result is allocated in the arena. */
+static struct cmdline *parseline(char *line) {
+    char *cur = line;
+    struct cmdline *head, *s;
+
+    head = s = parsepipeline(line, &cur);
+    while (!s->err && cur[strspn(cur, " \t")])
+        s = s->next = parsepipeline(line, &cur);
+    return s->err ? s : head;
+}
+
+
+struct cmdline *readcmd(void) {
+    char *line = readline();
+
+    /* Everything allocated for the previous line is given back at once */
+    areset();
+    if (line == NULL) {
+        freecmds();
+        return NULL;
+    }
+
+    statsstart(ST_PARSE);
+    struct cmdline *l = parseline(line);
+    statsstop(ST_PARSE);
+    return l;
+}
+
+
+/* Copy a word to the arena, replacing every VAR_STATUS by value (of length value_len), unless it has none */
+static char *expandword(char *word, char *value, size_t value_len) {
+    size_t len = 0, nb_vars = 0;
+    for (char *c = word; *c; c++, len++)
+        if (*c == VAR_STATUS) nb_vars++;
+    if (nb_vars == 0) return word;
+
+    char *expanded = aalloc(len + nb_vars * (value_len - 1) + 1), *w = expanded;
+    for (char *c = word; *c; c++) {
+        if (*c == VAR_STATUS) {
+            memcpy(w, value, value_len);
+            w += value_len;
+        } else
+            *w++ = *c;
+    }
+    *w = 0;
+    return expanded;
+}
+
+
+void expandcmd(struct cmdline *l, int status) {
+    char value[16];
+    size_t value_len;
+
+    if (!l->expand) return;
+    value_len = sprintf(value, "%d", status);
+    for (size_t k = 0; l->seq[k]; k++)
+        for (size_t i = 0; l->seq[k][i]; i++)
+            l->seq[k][i] = expandword(l->seq[k][i], value, value_len);
+    if (l->in) l->in = expandword(l->in, value, value_len);
+    if (l->out) l->out = expandword(l->out, value, value_len);
+    if (l->here) l->here = expandword(l->here, value, value_len);
+    if (l->errout) l->errout = expandword(l->errout, value, value_len);
+    l->expand = 0;
+}
+
+
+struct cmdline *copycmd(struct cmdline *l) {
+    size_t nb_cmds = 0, nb_words = 0, text_len = strlen(l->raw) + 1;
+    if (l->in) text_len += strlen(l->in) + 1;
+    if (l->out) text_len += strlen(l->out) + 1;
+    if (l->here) text_len += strlen(l->here) + 1;
+    if (l->errout) text_len += strlen(l->errout) + 1;
+    for (; l->seq[nb_cmds]; nb_cmds++)
+        for (size_t i = 0; l->seq[nb_cmds][i]; i++, nb_words++)
+            text_len += strlen(l->seq[nb_cmds][i]) + 1;
+
+    /* One block : the structure, the array of commands, the arrays of words, then the text of every string */
+    struct cmdline *c = xmalloc(sizeof(struct cmdline) + (nb_cmds + 1 + nb_words + nb_cmds) * sizeof(char *) + text_len);
+    char **ptrs = (char **) (c + 1);
+    char *text = (char *) (ptrs + nb_cmds + 1 + nb_words + nb_cmds);
+    *c = *l;
+    c->next = 0;
+    c->seq = (char ***) ptrs;
+    ptrs += nb_cmds + 1;
+    for (size_t k = 0; k < nb_cmds; k++) {
+        c->seq[k] = ptrs;
+        for (size_t i = 0; l->seq[k][i]; i++) {
+            *ptrs++ = text;
+            text = stpcpy(text, l->seq[k][i]) + 1;
         }
+        *ptrs++ = 0;
     }
-    free(words);
-    freeseq(seq);
-    for (i = 0; cmd[i] != 0; i++) free(cmd[i]);
-    free(cmd);
-    if (s->in) {
-        free(s->in);
-        s->in = 0;
+    c->seq[nb_cmds] = 0;
+    c->raw = text;
+    text = stpcpy(text, l->raw) + 1;
+    if (l->in) {
+        c->in = text;
+        text = stpcpy(text, l->in) + 1;
     }
-    if (s->out) {
-        free(s->out);
-        s->out = 0;
+    if (l->out) {
+        c->out = text;
+        text = stpcpy(text, l->out) + 1;
     }
-    if (s->raw) {
-        free(s->raw);
-        s->raw = 0;
+    if (l->here) {
+        c->here = text;
+        text = stpcpy(text, l->here) + 1;
     }
-    return s;
+    if (l->errout)
+        c->errout = strcpy(text, l->errout);
+    return c;
+}
+
+
+struct cmdline **readscript(char *text, size_t len) {
+    struct cmdline **lines = 0;
+    size_t nb_lines = 0, lines_cap = 0;
+    char *cur = text, *end = text + len, *nl;
+
+    areset();
+    while (cur < end) {
+        if ((nl = memchr(cur, '\n', end - cur)) != NULL)
+            *nl = 0;
+        else { /* The last line lacks its '\n', there may be no room for a null character after it */
+            char *last = aalloc(end - cur + 1);
+            memcpy(last, cur, end - cur);
+            last[end - cur] = 0;
+            cur = last;
+            nl = end - 1;
+        }
+        lines = push(lines, &lines_cap, nb_lines, sizeof(struct cmdline *));
+        statsstart(ST_PARSE);
+        lines[nb_lines++] = parseline(cur);
+        statsstop(ST_PARSE);
+        cur = nl + 1;
+    }
+
+    struct cmdline **script = acopy(lines, nb_lines);
+    free(lines);
+    return script;
 }
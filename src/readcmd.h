@@ -5,10 +5,37 @@
 #ifndef __READCMD_H
 #define __READCMD_H
 
+#include <stddef.h>
+
 /* Read a command line from input stream. Return null when input closed.
-Display an error and call exit() in case of memory exhaustion. */
+A line made of several pipelines is returned as a list of command lines, chained through their next field.
+Display an error and call exit() in case of memory exhaustion.
+The command line stays valid until the next call to readcmd() or readscript(). */
 struct cmdline *readcmd(void);
 
+/* Parse a whole script at once, its text is modified in place and must stay valid as long as the result is used.
+Return a null terminated array with one command line (or list of command lines) per line of the script, valid until the next call to readcmd()
+or readscript(). */
+struct cmdline **readscript(char *text, size_t len);
+
+/* Replace "$?" (unless it was single quoted) by the given exit status in the words, the file names and the
+here-string of a command line. Expanded words are allocated like the command line itself, a command line is only expanded once. */
+void expandcmd(struct cmdline *l, int status);
+
+/* Copy a command line without error (and everything it points to, but not the rest of its list) to a single block, to
+be freed with free(). Unlike the command lines returned by readcmd(), the copy stays valid after the next call to
+readcmd() or readscript(). */
+struct cmdline *copycmd(struct cmdline *l);
+
+/* Tell whether the next call to readcmd() can return without reading standard input, that is if a whole line (or
+the end of the input) is already buffered. */
+int inputpending(void);
+
+
+/* How the next command line of a list is run, according to the exit status of the previous one */
+#define L_SEQ 0  // ";", "&" or the end of the line : always
+#define L_AND 1  // "&&" : if the previous one succeeded
+#define L_OR 2   // "||" : if the previous one failed
 
 /* Structure returned by readcmd() */
 struct cmdline {
@@ -16,12 +43,33 @@ struct cmdline {
     char *err;    // If not null, it is an error message that should be displayed. The other fields are null.
     char *in;     // If not null : name of file for input redirection.
     char *out;    // If not null : name of file for output redirection.
+    char *here;   // If not null : text given as input by a "<<<" here-string (a newline is added), in is then null.
+    int append;   // 1 if the output file is appended to (">>"), 0 if it is truncated (">").
+    char *errout; // If not null : name of file for error redirection ("2>" or "2>>").
+    int errappend;  // 1 if the error file is appended to ("2>>"), 0 if it is truncated ("2>").
+    int errdup;   // 1 if the standard error is the final standard output of its command ("2>&1", "&>"), errout is null.
+                  // 2 if "2>&1" comes before the output redirection, it is then the standard output before it.
+    int errcmd;   // Index of the command whose standard error is redirected, the one it was written after.
     char ***seq;  // See comment below
-    char *raw;    // Raw command line
+    char *raw;    // Raw command line, only the text of this pipeline if the line holds a list
+    int time;     // 1 if the command line starts with the "time" keyword, 2 with "time -v" (not part of seq), else 0
+    int expand;   // 1 if some words contain "$?", expandcmd() must be called before the execution
+    int op;       // How the next command line of the list is run, see L_SEQ, L_AND and L_OR
+    struct cmdline *next;  // Next command line of the list, null if this is the last one
 };
 typedef struct cmdline Cmdline;
 
-void freecmd2(struct cmdline *s);
+/* Free all the command lines returned by readcmd() or readscript() and all the memory they point to.
+Only needed before exiting : every call to readcmd() reuses the memory of the previous command line. */
+void freecmds(void);
+
+/* Redirections of struct cmdline :
+The input redirection applies to the first command and the output redirection to the last one, wherever they are
+written in the pipeline. The error redirection applies to the command it was written after ("a 2>&1 | b" sends the
+errors of a into the tube). "&> file" is "> file 2>&1". Like sh, "2>&1" duplicates the standard output as it is at
+that point : written after the output redirection it follows it (errdup 1), written before it ("2>&1 > file") it keeps
+the previous standard output, the tube or the terminal (errdup 2).
+*/
 
 /* Field seq of struct cmdline :
 A command line is a sequence of commands whose output is linked to the input
@@ -6,244 +6,730 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <limits.h>
+#include <spawn.h>
 #include "readcmd.h"
 #include "shell_commands.h"
 #include "jobs.h"
+#include "events.h"
+#include "options.h"
+#include "cmdhash.h"
+#include "prompt.h"
+#include "stats.h"
+#include "trace.h"
+#include "transfer.h"
 #include "csapp.h"
 
-// La vie est plus belle avec des couleurs
-#define GREEN "\e[1;32m"
-#define BLUE "\e[1;34m"
-#define RESET "\e[0m"
-
 #define PIPE_READ 0
 #define PIPE_WRITE 1
 
+// Indexes of the fds opened by openredirs()
+#define REDIR_IN 0      // Standard input of the first command
+#define REDIR_OUT 1     // Standard output of the last command
+#define REDIR_ERR 2     // Standard error of the command l->errcmd
+#define REDIR_FAILED -2 // The file could not be opened, the command is not launched
+
 
-static sigset_t mask_all, prev_mask;
+static sigset_t mask_all;
 static int shellprint = 1;
+static int shell_fds[3] = {-1, -1, -1};  // Standard output and error of the shell while run_internal() replaces them
 
 
-// handle_int - SIGINT handler
-void handle_int(int sig) {
-    // If there is a foreground job, terminate it
-    int fg = getfg();
-    if (fg != -1)
-        termjob(fg);
-}
+/* fork_stage - Fork a child process that executes one command of the command line
+ * Arguments :
+ *  - l - The whole command line (Cmdline structure)
+ *  - i - The index of the command in the command line
+ *  - nb_cmds - The number of commands in the command line
+ *  - pgid - The process group to join, 0 to create a new one
+ *  - old_tube - The tube between command i - 1 and i
+ *  - new_tube - The tube between command i and i + 1
+ *  - redirs - The fds of the redirections of the command line (see openredirs())
+ *  - path - The path of the executable of an external command (see hashlookup()), NULL for an internal command
+ * Return value : The pid of the child process
+ * Notes : Used for internal commands, which are executed by the child itself, and when spawn is disabled
+ */
+static pid_t fork_stage(Cmdline *l, int i, int nb_cmds, pid_t pgid, int old_tube[2], int new_tube[2], int redirs[3],
+                        char *path) {
+    pid_t pid;
 
-// handle_tstp - SIGTSTP handler
-void handle_tstp(int sig) {
-    // If there is a foreground job, stop it
-    int fg = getfg();
-    if (fg == -1)
-        return;
+    fflush(stdout);  // Otherwise an internal command would print the pending output of the shell a second time
+    if ((pid = Fork()) == 0) {
+        // Child
 
-    // Use return value of stopjob() to check for errors
-    switch (stopjob(fg)) {
-        case 2:
-            fprintf(stderr, "stop: Job already stopped\n");
-            break;
-        case 1:
-            fprintf(stderr, "stop: No such job\n");
-            break;
-        case 0:  // Everything went well
-        default:
-            if (shellprint)
-                printf("\n[%d] %d  Suspended  %s\n", fg, getjobpgid(fg), getjobcmd(fg));
-            break;
+        // Join the group of the command line on our own as well, the parent may only do it after our execvp()
+        setpgid(0, pgid);
+
+        // Input Redirect if first command
+        if ((redirs[REDIR_IN] >= 0) && (i == 0))
+            Dup2(redirs[REDIR_IN], 0);
+
+        // Prepare to read if not first command
+        if (i > 0) {
+            Close(old_tube[PIPE_WRITE]);
+            Dup2(old_tube[PIPE_READ], 0);
+        }
+
+        // Prepare to write if not last command
+        if (i + 1 < nb_cmds) {
+            Close(new_tube[PIPE_READ]);
+            Dup2(new_tube[PIPE_WRITE], 1);
+        }
+
+        // Error Redirect written before the output one ("2>&1 > file")
+        if (i == l->errcmd && l->errdup == 2)
+            Dup2(1, 2);
+
+        // Output Redirect if last command
+        if ((redirs[REDIR_OUT] >= 0) && (i == nb_cmds - 1))
+            Dup2(redirs[REDIR_OUT], 1);
+
+        // Error Redirect, after the output that "2>&1" duplicates
+        if (i == l->errcmd && l->errdup == 1)
+            Dup2(1, 2);
+        else if (i == l->errcmd && redirs[REDIR_ERR] >= 0)
+            Dup2(redirs[REDIR_ERR], 2);
+
+        // No need to keep job list in child process, freeing memory
+        freejobs();
+
+        // Unblock all signals, the shell blocked those it reads from its signalfd
+        // No handler to reset to SIG_DFL, the shell does not install any, but it ignores SIGPIPE
+        Signal(SIGPIPE, SIG_DFL);
+        Sigprocmask(SIG_UNBLOCK, &mask_all, NULL);
+
+        // Exit with the status of the internal command (thus executed), errors will be printed in standard error
+        if (path == NULL) {
+            int status = EXIT_SUCCESS;
+            // Without execvp(), the fds of the shell are not closed on exec, like its copies of the write ends of tubes
+            // which would prevent the command from reading the end of its input
+            closefrom(3);
+            hashclear();
+            check_internal_commands(l, i, &status);
+            exit(status);
+        }
+
+        // Execute the external command, execvp() searches $PATH again if the remembered executable disappeared and
+        // hands scripts without shebang over to the system shell
+        execv(path, l->seq[i]);
+        if (errno == ENOENT || errno == ENOEXEC)
+            execvp(l->seq[i][0], l->seq[i]);
+        perror(l->seq[i][0]);
+        hashclear();
+        freecmds();
+        exit(EXIT_FAILURE);
     }
+    // Parent
+
+    // Make the child join its group, EACCES means the child already did it itself and called execvp()
+    if (setpgid(pid, pgid == 0 ? pid : pgid) < 0 && errno != EACCES)
+        unix_error("Setpgid error");
+    return pid;
 }
 
-// handle_child - SIGCHLD handler
-void handle_child(int sig) {
-    int olderrno = errno;               // Save errno
-    int status;
+/* spawn_stage - Launch one external command of the command line with posix_spawn()
+ * Arguments : Same as fork_stage(), path cannot be NULL
+ * Return value : The pid of the child process
+ *                -1 if the command could not be launched, an error is printed
+ * Notes : The redirections, the tubes, the process group and the signal mask are described by spawn attributes and
+ *         file actions, so the child never duplicates the memory of the shell. The files of the redirections are
+ *         already opened, the child only duplicates them
+ */
+static pid_t spawn_stage(Cmdline *l, int i, int nb_cmds, pid_t pgid, int old_tube[2], int new_tube[2], int redirs[3],
+                         char *path) {
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t sigdefault, sigmask;
     pid_t pid;
-    // Reaping all terminated children, but managing Stopped and Continued children as well
-    while ((pid = waitpid(-1, &status, WNOHANG | WUNTRACED | WCONTINUED)) > 0) {
-        if (WIFSTOPPED(status))
-            stopjobpid(pid);            // If the child was stopped, put the job in "Stopped" status
-        else if (WIFCONTINUED(status))
-            contjobpid(pid);            // If the child was continued, put the job in "Running" status
-        else
-            deletejobpid(pid);          // Delete the child from the job list
+    int err;
+
+    posix_spawn_file_actions_init(&actions);
+    // Input Redirect if first command
+    if ((redirs[REDIR_IN] >= 0) && (i == 0))
+        posix_spawn_file_actions_adddup2(&actions, redirs[REDIR_IN], 0);
+    // Prepare to read if not first command
+    if (i > 0) {
+        posix_spawn_file_actions_addclose(&actions, old_tube[PIPE_WRITE]);
+        posix_spawn_file_actions_adddup2(&actions, old_tube[PIPE_READ], 0);
+        posix_spawn_file_actions_addclose(&actions, old_tube[PIPE_READ]);
+    }
+    // Prepare to write if not last command
+    if (i + 1 < nb_cmds) {
+        posix_spawn_file_actions_addclose(&actions, new_tube[PIPE_READ]);
+        posix_spawn_file_actions_adddup2(&actions, new_tube[PIPE_WRITE], 1);
+        posix_spawn_file_actions_addclose(&actions, new_tube[PIPE_WRITE]);
+    }
+    // Error Redirect written before the output one ("2>&1 > file")
+    if (i == l->errcmd && l->errdup == 2)
+        posix_spawn_file_actions_adddup2(&actions, 1, 2);
+    // Output Redirect if last command
+    if ((redirs[REDIR_OUT] >= 0) && (i == nb_cmds - 1))
+        posix_spawn_file_actions_adddup2(&actions, redirs[REDIR_OUT], 1);
+    // Error Redirect, after the output that "2>&1" duplicates
+    if (i == l->errcmd && l->errdup == 1)
+        posix_spawn_file_actions_adddup2(&actions, 1, 2);
+    else if (i == l->errcmd && redirs[REDIR_ERR] >= 0)
+        posix_spawn_file_actions_adddup2(&actions, redirs[REDIR_ERR], 2);
+
+    // Join the group of the command line, reset the signals the shell uses and unblock every signal
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK);
+    posix_spawnattr_setpgroup(&attr, pgid);
+    Sigemptyset(&sigdefault);
+    Sigaddset(&sigdefault, SIGCHLD);
+    Sigaddset(&sigdefault, SIGINT);
+    Sigaddset(&sigdefault, SIGTSTP);
+    Sigaddset(&sigdefault, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attr, &sigdefault);
+    Sigemptyset(&sigmask);
+    posix_spawnattr_setsigmask(&attr, &sigmask);
+
+    err = posix_spawn(&pid, path, &actions, &attr, l->seq[i], environ);
+    if (err == ENOENT && path != l->seq[i][0]) {
+        // The remembered executable disappeared, search $PATH again
+        hashforget(l->seq[i][0]);
+        if ((path = hashlookup(l->seq[i][0])) != NULL)
+            err = posix_spawn(&pid, path, &actions, &attr, l->seq[i], environ);
+    }
+    if (err == ENOEXEC) {
+        // Unlike execvp(), posix_spawn() does not hand scripts without shebang over to the system shell
+        int argc = 0;
+        while (l->seq[i][argc] != NULL)
+            argc++;
+        char *argv[argc + 2];
+        argv[0] = "/bin/sh";
+        argv[1] = path;
+        memcpy(argv + 2, l->seq[i] + 1, argc * sizeof(char *));
+        err = posix_spawn(&pid, argv[0], &actions, &attr, argv, environ);
+    }
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (err != 0) {
+        fprintf(stderr, "%s: %s\n", l->seq[i][0], strerror(err));
+        return -1;
     }
-    errno = olderrno;                   // Restore errno
+    return pid;
 }
 
-/* show_prompt - Prints the command prompt in standard output, with nice colors and stuff :)
- * Arguments : None
+/* run_internal - Execute an internal command of the command line in the shell itself
+ * Arguments :
+ *  - l - The whole command line (Cmdline structure)
+ *  - i - The index of the command in the command line
+ *  - out - The fd to use as standard output during the command, it is closed, -1 to keep the standard output
+ *  - err - The fd to use as standard error during the command, it is closed, -1 to keep the standard error
+ * Return value : The exit status of the command
+ * Notes : Internal commands executed by the shell never read their standard input, so they do not need one.
+ *         The standard output and error of the shell are kept in shell_fds meanwhile (see launch_queued())
+ */
+static int run_internal(Cmdline *l, int i, int out, int err) {
+    int status = EXIT_SUCCESS;
+
+    if (out != -1) {
+        fflush(stdout);  // The pending output of the shell goes to its own standard output
+        if ((shell_fds[1] = fcntl(1, F_DUPFD_CLOEXEC, 0)) < 0)
+            unix_error("Fcntl error");
+        Dup2(out, 1);
+        Close(out);
+    }
+    if (err != -1) {
+        if ((shell_fds[2] = fcntl(2, F_DUPFD_CLOEXEC, 0)) < 0)
+            unix_error("Fcntl error");
+        Dup2(err, 2);
+        Close(err);
+    }
+    check_internal_commands(l, i, &status);
+    fflush(stdout);  // Spawned commands would otherwise write before the output of the command
+    for (int fd = 1; fd <= 2; fd++) {
+        if (shell_fds[fd] != -1) {
+            Dup2(shell_fds[fd], fd);
+            Close(shell_fds[fd]);
+            shell_fds[fd] = -1;
+        }
+    }
+    return status;
+}
+
+/* dupcloexec - Duplicate a fd, closed on exec
+ * Arguments :
+ *  - fd - The fd to duplicate
+ * Return value : The new fd
+ */
+static int dupcloexec(int fd) {
+    int copy = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (copy < 0)
+        unix_error("Fcntl error");
+    return copy;
+}
+
+/* openhere - Give the text of a here-string to read from a fd
+ * Arguments :
+ *  - text - The text, a newline is added after it
+ * Return value : The fd, closed on exec
+ *                REDIR_FAILED on an error (it is printed)
+ * Notes : A short text is written into a tube, which cannot block as it is never smaller than PIPE_BUF, a longer one
+ *         into an unnamed temporary file
+ */
+static int openhere(char *text) {
+    size_t len = strlen(text);
+    int tube[2], fd;
+
+    if (len + 1 <= PIPE_BUF) {
+        if (pipe(tube) < 0) {
+            perror("here-string");
+            return REDIR_FAILED;
+        }
+        fd = dupcloexec(tube[PIPE_READ]);
+        Close(tube[PIPE_READ]);
+        if (rio_writen(tube[PIPE_WRITE], text, len) != len || rio_writen(tube[PIPE_WRITE], "\n", 1) != 1)
+            perror("here-string");
+        Close(tube[PIPE_WRITE]);
+        return fd;
+    }
+
+    FILE *tmp = tmpfile();
+    if (tmp == NULL || fwrite(text, 1, len, tmp) != len || fputc('\n', tmp) == EOF || fflush(tmp) == EOF) {
+        perror("here-string");
+        if (tmp != NULL)
+            fclose(tmp);
+        return REDIR_FAILED;
+    }
+    fd = dupcloexec(fileno(tmp));  // Shares the offset, rewinding one rewinds the other
+    fclose(tmp);
+    lseek(fd, 0, SEEK_SET);
+    return fd;
+}
+
+/* openredirs - Open the files of the redirections of a command line, once for all of its commands
+ * Arguments :
+ *  - l - The whole command line (Cmdline structure)
+ *  - redirs - Filled with the fds indexed by the REDIR_* constants, -1 if not redirected, REDIR_FAILED if the file could
+ *             not be opened (an error is printed)
  * Return value : None
+ * Notes : The fds are closed on exec, the commands are given copies with dup2(), and closeredirs() closes them
  */
-void show_prompt() {
-    char *home = getenv("HOME");
-    char hostname[256];                                 // 255 is the max length of a hostname
-    gethostname(hostname, 255);
-
-    char *pwd = getcwd(NULL, 0);                        //  -|
-    int cmp = (strncmp(pwd, home, strlen(home)) == 0);  //   |
-    size_t homelen = strlen(home);                      //   |
-    if (cmp) {                                          //   |> Get CWD and manipulate it to display "~"
-        pwd += homelen - 1;                             //   |  instead of the home path
-        *pwd = '~';                                     //   |
-    }                                                   //  -|
-    // Show a nice prompt
-    printf("%s%s@%s%s:%s%s%s$ ", GREEN, getenv("USER"), hostname, RESET, BLUE, pwd, RESET);
-    if (cmp)                                            //  -|
-        pwd -= homelen - 1;                             //   |> Restore and free pwd
-    free(pwd);                                          //  -|
+static void openredirs(Cmdline *l, int redirs[3]) {
+    redirs[REDIR_IN] = redirs[REDIR_OUT] = redirs[REDIR_ERR] = -1;
+
+    if (l->in != NULL && (redirs[REDIR_IN] = open(l->in, O_RDONLY | O_CLOEXEC)) < 0) {
+        perror(l->in);
+        redirs[REDIR_IN] = REDIR_FAILED;
+    }
+    if (l->here != NULL)
+        redirs[REDIR_IN] = openhere(l->here);
+    // ">" truncates the file, ">>" appends to it
+    if (l->out != NULL &&
+        (redirs[REDIR_OUT] = open(l->out, O_CREAT | O_WRONLY | O_CLOEXEC | (l->append ? O_APPEND : O_TRUNC), 0644)) < 0) {
+        perror(l->out);
+        redirs[REDIR_OUT] = REDIR_FAILED;
+    }
+    if (l->errout != NULL &&
+        (redirs[REDIR_ERR] = open(l->errout, O_CREAT | O_WRONLY | O_CLOEXEC | (l->errappend ? O_APPEND : O_TRUNC),
+                                  0644)) < 0) {
+        perror(l->errout);
+        redirs[REDIR_ERR] = REDIR_FAILED;
+    }
 }
 
-/* exec_cmd() - Fork into child processes that will execute the command line,
- *              with or without I/O redirection, and with or without piped processes
+/* closeredirs - Close the fds opened by openredirs()
  * Arguments :
- *  - l - A pointer to the Cmdline struct that represents the scanned command line to execute
+ *  - redirs - The fds
  * Return value : None
  */
-void exec_cmd(Cmdline *l) {
-    // Block SIGCHLD
-    Sigprocmask(SIG_BLOCK, &mask_all, &prev_mask);
+static void closeredirs(int redirs[3]) {
+    for (int k = 0; k < 3; k++)
+        if (redirs[k] >= 0)
+            Close(redirs[k]);
+}
 
-    int pids_len = 1;
-    while (l->seq[pids_len] != NULL)
-        pids_len++;
+/* launch_cmd() - Launch the child processes that will execute the command line,
+ *                with or without I/O redirection, and with or without piped processes
+ * Arguments :
+ *  - l - A pointer to the Cmdline struct that represents the scanned command line to execute
+ *  - queued - The id of the queued job of the command line (see queuejob()), -1 to create a new job
+ *  - names - Filled with the names of the commands that were launched, in the order of the pids of the job, may be
+ *            NULL, otherwise it must have room for one name per command of the command line
+ *  - status - Filled with the exit status of the command line if it has no process (internal commands executed by the
+ *             shell itself, commands that could not be launched), left unchanged otherwise
+ * Return value : The id of the job of the command line
+ *                -1 if nothing could be launched
+ * Notes : External commands are spawned if the "spawn" option is set.
+ *         Internal commands are executed by the shell itself, writing into their tube, once the processes are launched
+ *         and the job is added. They are only forked in background command lines of more than one command, if they
+ *         read their standard input, or if they change the state of the shell without being the last command, like
+ *         the subshells of sh (see mustfork()).
+ *         The executables of external commands are found by hashlookup() in the shell, not by each child.
+ *         The files of the redirections are opened once by the shell (see openredirs()), a command whose redirection
+ *         failed is not launched
+ */
+static int launch_cmd(Cmdline *l, int queued, char **names, int *status) {
+    // No need to block SIGCHLD : it is only read from the signalfd once the job has been added
+    int nb_cmds = 1;
+    while (l->seq[nb_cmds] != NULL)
+        nb_cmds++;
 
     int old_tube[2], new_tube[2];
 
-    pid_t pids[pids_len];
-    for (int i = 0; i < pids_len; i++) {
+    pid_t pids[nb_cmds];
+    char *stage_names[nb_cmds];
+    int pids_len = 0;
+    int internals[nb_cmds], internal_outs[nb_cmds], internal_errs[nb_cmds];  // Executed by the shell, and their outputs
+    int internals_len = 0;
+    int statuses[nb_cmds];   // Exit status of the commands that are not processes, -1 for the processes
+    size_t befores[nb_cmds]; // Number of processes launched before each command
+    int redirs[3];
+    openredirs(l, redirs);
+    if (names == NULL)
+        names = stage_names;  // Needed anyway to trace the processes
+    pid_t pgid = 0;  // The first process launched is the group leader
+    for (int i = 0; i < nb_cmds; i++) {
         old_tube[PIPE_READ] = new_tube[PIPE_READ];
         old_tube[PIPE_WRITE] = new_tube[PIPE_WRITE];
 
-        // Create nb_commands - 1 tubes
-        if (i + 1 < pids_len)
+        // Create nb_commands - 1 tubes, bigger ones cost less context switches to the commands moving much data
+        if (i + 1 < nb_cmds) {
             pipe(new_tube);
+            if (getoption(OPT_PIPESIZE) > 0)
+                settubesize(new_tube[PIPE_WRITE], getoption(OPT_PIPESIZE));
+        }
 
-        if ((pids[i] = Fork()) == 0) {
-            // Child
+        pid_t pid = -1;
+        char *path = NULL;
+        statuses[i] = 127;  // Unless it is launched, like sh
+        befores[i] = pids_len;
+        statsstart(ST_LAUNCH);
+        if ((i == 0 && redirs[REDIR_IN] == REDIR_FAILED) || (i + 1 == nb_cmds && redirs[REDIR_OUT] == REDIR_FAILED) ||
+            (i == l->errcmd && redirs[REDIR_ERR] == REDIR_FAILED)) {
+            // Not executed, like sh, the error was printed by openredirs()
+            statuses[i] = EXIT_FAILURE;
+        } else if (isinternal(l->seq[i]) && !mustfork(l->seq[i], i + 1 == nb_cmds) && (!l->bg || nb_cmds == 1)) {
+            // Executed later by the shell, it only keeps the write end of its tube, or its output file
+            int out = -1, err = -1;
+            if (i + 1 < nb_cmds)
+                out = dupcloexec(new_tube[PIPE_WRITE]);
+            else if (redirs[REDIR_OUT] >= 0)
+                out = dupcloexec(redirs[REDIR_OUT]);
+            if (i == l->errcmd && l->errdup == 2 && i + 1 == nb_cmds)
+                err = dupcloexec(1);  // The output before its redirection
+            else if (i == l->errcmd && l->errdup)
+                err = dupcloexec(out != -1 ? out : 1);
+            else if (i == l->errcmd && redirs[REDIR_ERR] >= 0)
+                err = dupcloexec(redirs[REDIR_ERR]);
+            internals[internals_len] = i;
+            internal_outs[internals_len] = out;
+            internal_errs[internals_len++] = err;
+        } else if (isinternal(l->seq[i]))
+            pid = fork_stage(l, i, nb_cmds, pgid, old_tube, new_tube, redirs, NULL);
+        else if ((path = hashlookup(l->seq[i][0])) == NULL)
+            fprintf(stderr, "%s: %s\n", l->seq[i][0], strerror(ENOENT));  // Not in $PATH, no need to launch it
+        else if (getoption(OPT_SPAWN))
+            pid = spawn_stage(l, i, nb_cmds, pgid, old_tube, new_tube, redirs, path);
+        else
+            pid = fork_stage(l, i, nb_cmds, pgid, old_tube, new_tube, redirs, path);
+
+        if (pid > 0) {
+            statuses[i] = -1;
+            statsstop(ST_LAUNCH);
+            if (pgid == 0)
+                pgid = pid;
+            names[pids_len] = l->seq[i][0];
+            pids[pids_len++] = pid;
+        }
 
-            // Input Redirect if first command
-            if ((l->in != NULL) && (i == 0)) {
-                int fd = Open(l->in, O_RDONLY, 0);
-                Dup2(fd, 0);
-            }
+        // Close tube between process i - 1 and i
+        if ((nb_cmds > 1) && (i > 0)) {
+            Close(old_tube[PIPE_READ]);
+            Close(old_tube[PIPE_WRITE]);
+        }
+    }
+    // Parent
+    closeredirs(redirs);
+
+    int job_id = -1;
+    if (queued != -1) {
+        // A queued job was announced when it was queued, it only has to be given its processes
+        startjob(queued, pids, pids_len);
+        for (int i = 0; i < pids_len; i++)
+            tracestage(pids[i], queued, names[i]);
+        if (pids_len > 0)
+            job_id = queued;
+    } else if (pids_len > 0) {
+        job_id = addjob(l->raw, pids, pids_len);
+        for (int i = 0; i < pids_len; i++)
+            tracestage(pids[i], job_id, names[i]);
+        if (l->bg == 0)
+            setfg(job_id);
+        else if (shellprint)
+            printf("[%d] %d\n", job_id, pids[0]);
+    }
 
-            // Prepare to read if not first command
-            if (i > 0) {
-                Close(old_tube[PIPE_WRITE]);
-                Dup2(old_tube[PIPE_READ], 0);
+    // The processes of the job are known, the last command may reap them (like "wait")
+    for (int k = 0; k < internals_len; k++)
+        statuses[internals[k]] = run_internal(l, internals[k], internal_outs[k], internal_errs[k]);
+
+    // The commands that are not processes count in the exit status like the processes, with the "pipefail" option as
+    // well, like with the "lastpipe" option of bash the last command sets it when it is internal
+    // A queued job is kept even if nothing could be launched, to be notified as "Done"
+    int status_job = (queued != -1) ? queued : job_id;
+    for (int i = 0; i < nb_cmds; i++)
+        if (statuses[i] != -1 && status_job != -1)
+            setshellstatus(status_job, befores[i], i + 1 == nb_cmds, statuses[i]);
+    if (job_id == -1) {
+        *status = statuses[nb_cmds - 1];
+        for (int i = nb_cmds; getoption(OPT_PIPEFAIL) && i-- > 0;) {
+            if (statuses[i] > 0) {
+                *status = statuses[i];
+                break;
             }
+        }
+    }
+    return job_id;
+}
 
-            // Prepare to write if not last command
-            if (i + 1 < pids_len) {
-                Close(new_tube[PIPE_READ]);
-                Dup2(new_tube[PIPE_WRITE], 1);
-            }
+/* launch_queued - Launch a queued job, called by the scheduler of the jobs (see setlauncher())
+ * Arguments :
+ *  - l - A copy of the command line of the job
+ *  - job_id - The id of the queued job
+ * Return value : None
+ * Notes : An internal command executed by the shell may launch it while reaping the jobs (like "wait"), the job gets
+ *         the standard output and error of the shell, not the redirections of the internal command
+ */
+static void launch_queued(Cmdline *l, int job_id) {
+    int status, current[3] = {-1, -1, -1};
+
+    fflush(stdout);  // The pending output of the internal command goes to its own standard output
+    for (int fd = 1; fd <= 2; fd++) {
+        if (shell_fds[fd] != -1) {
+            current[fd] = dupcloexec(fd);
+            Dup2(shell_fds[fd], fd);
+        }
+    }
+    launch_cmd(l, job_id, NULL, &status);  // A queued command line is in background, its commands are all forked
+    fflush(stdout);
+    for (int fd = 1; fd <= 2; fd++) {
+        if (current[fd] != -1) {
+            Dup2(current[fd], fd);
+            Close(current[fd]);
+        }
+    }
+}
 
-            // Output Redirect if last command
-            if ((l->out != NULL) && (i == pids_len - 1)) {
-                int fd = Open(l->out, O_CREAT | O_WRONLY, 0644);
-                Dup2(fd, 1);
-            }
+/* exec_cmd() - Launch the command line, or queue it if it is in background and "maxjobs" jobs are already running
+ * Arguments : Same as launch_cmd(), without queued
+ * Return value : The id of the job of the command line
+ *                -1 if nothing could be launched
+ * Notes : A lone internal command is never queued when it is executed by the shell itself
+ */
+int exec_cmd(Cmdline *l, char **names, int *status) {
+    if (!l->bg || !mustqueue() || (l->seq[1] == NULL && isinternal(l->seq[0]) && !mustfork(l->seq[0], 1)))
+        return launch_cmd(l, -1, names, status);
+
+    int job_id = queuejob(l);
+    if (shellprint)
+        printf("[%d] Queued\n", job_id);
+    return job_id;
+}
 
-            // No need to keep job list in child process, freeing memory
-            freejobs();
-
-            // Unblock all signals
-            Sigprocmask(SIG_UNBLOCK, &mask_all, NULL);
-            // Make sure all signal handlers are SIG_DFL
-            for (int sig = 1; sig < 32; sig++)  // 31 signals total
-                if (sig != SIGKILL && sig != SIGSTOP)
-                    Signal(sig, SIG_DFL);
-
-            // Exit with success if it is an internal command (thus executed), errors will be printed in standard error
-            if (check_internal_commands(l, i) == 1)
-                exit(EXIT_SUCCESS);
-
-            // Execute the external command with check for failure
-            if (execvp(l->seq[i][0], l->seq[i]) == -1) {
-                perror(l->seq[i][0]);
-                freecmd2(l);
-                exit(EXIT_FAILURE);
-            }
-        }
-        // Parent
+/* print_times - Print the times of a command line prefixed by the "time" keyword, on the error output like sh
+ * Arguments :
+ *  - start - The monotonic time at which the command line was started, in nanoseconds
+ *  - job_id - The id of the job of the command line, -1 if it had none (internal command, nothing launched)
+ *  - names - The names of the commands of the job, in the order of its pids, NULL to only print the totals
+ * Return value : None
+ * Notes : The user and system times and the max RSS are those of the processes of the job (see getjobusage()),
+ *         with names ("time -v") they are also printed for each process, to find the slowest stage of a pipeline
+ */
+static void print_times(long long start, int job_id, char **names) {
+    struct timespec ts;
+    struct rusage usage;
+    long long real;
+    pid_t pid;
 
-        // Make first process in command line the group leader of the brother processes of the command line
-        Setpgid(pids[i], pids[0]);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    real = ts.tv_sec * 1000000000LL + ts.tv_nsec - start;
+    if (getjobusage(job_id, &start, &usage) != 0)
+        memset(&usage, 0, sizeof(struct rusage));
 
-        // Close tube between process i - 1 and i
-        if ((pids_len > 1) && (i > 0)) {
-            Close(old_tube[PIPE_READ]);
-            Close(old_tube[PIPE_WRITE]);
+    fprintf(stderr, "real\t%lldm%lld.%03llds\n", real / 60000000000LL, real / 1000000000LL % 60, real / 1000000 % 1000);
+    fprintf(stderr, "user\t%ldm%ld.%03lds\n", (long) usage.ru_utime.tv_sec / 60, (long) usage.ru_utime.tv_sec % 60,
+            (long) usage.ru_utime.tv_usec / 1000);
+    fprintf(stderr, "sys\t%ldm%ld.%03lds\n", (long) usage.ru_stime.tv_sec / 60, (long) usage.ru_stime.tv_sec % 60,
+            (long) usage.ru_stime.tv_usec / 1000);
+    fprintf(stderr, "maxrss\t%ldk\n", usage.ru_maxrss);  // At least the one of the shell if spawned, see getjobusage()
+
+    if (names == NULL)
+        return;
+    // Per stage breakdown, the real time of a stage is the time from the start of the job to its termination
+    fprintf(stderr, "stage  %7s  %11s  %11s  %11s  %9s  %s\n", "pid", "real", "user", "sys", "maxrss", "command");
+    for (size_t i = 0; getstageusage(job_id, i, &pid, &real, &usage) == 0; i++)
+        fprintf(stderr, "%5zu  %7d  %6lld.%03llds  %6ld.%03lds  %6ld.%03lds  %8ldk  %s\n", i, pid,
+                real / 1000000000LL, real / 1000000 % 1000,
+                (long) usage.ru_utime.tv_sec, (long) usage.ru_utime.tv_usec / 1000,
+                (long) usage.ru_stime.tv_sec, (long) usage.ru_stime.tv_usec / 1000, usage.ru_maxrss, names[i]);
+}
+
+
+/* run_cmd - Execute a command line, and wait for it if it is in foreground
+ * Arguments :
+ *  - l - A pointer to the Cmdline struct, as returned by readcmd() or readscript()
+ * Return value : None
+ * Notes : "$?" is expanded right before the execution, and then set to the exit status of the command line like sh :
+ *         the one of its job if it is in foreground, 0 if it is in background, 127 if nothing could be launched
+ */
+static void run_cmd(Cmdline *l) {
+    // Syntax error, nothing to execute
+    if (l->err) {
+        fprintf(stderr, "synthax error: %s\n", l->err);
+        setstatus(2);
+        return;
+    }
+    expandcmd(l, getstatus());
+
+    struct timespec start;
+    int job_id = -1;
+    int status = getstatus();  // An empty command line does not change it
+    int internal_status = -1;
+    size_t nb_cmds = 0;
+    while (l->seq[nb_cmds] != NULL)
+        nb_cmds++;
+    char *launched[nb_cmds + 1];
+    char **names = (l->time == 2) ? launched : NULL;  // "time -v" needs the names of the commands of the job
+
+    if (l->time)
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // Execute the command line, nothing to do for an empty one
+    if (nb_cmds > 0) {
+        job_id = exec_cmd(l, names, &internal_status);
+        waitfgjob();
+        if (job_id != -1)
+            status = l->bg ? 0 : getjobstatus(job_id);
+        else if (internal_status != -1)
+            status = internal_status;
+        else
+            status = 127;
+    }
+    setstatus(status);
+
+    if (l->time)
+        print_times(start.tv_sec * 1000000000LL + start.tv_nsec, job_id, names);
+}
+
+/* run_list - Execute a list of command lines, each one depending on the exit status of the previous one
+ * Arguments :
+ *  - l - A pointer to the first Cmdline struct of the list, as returned by readcmd() or readscript()
+ * Return value : None
+ * Notes : Like sh, a command line skipped by "&&" or "||" keeps the exit status, so "a && b || c" runs c if a fails
+ */
+static void run_list(Cmdline *l) {
+    for (; l != NULL; l = l->next) {
+        run_cmd(l);
+        // Skip the command lines that must not run, until one can or the list ends
+        while (l->next != NULL && ((l->op == L_AND && getstatus() != 0) || (l->op == L_OR && getstatus() == 0)))
+            l = l->next;
+    }
+}
+
+/* run_script - Execute a whole script, parsed up front instead of line by line
+ * Arguments :
+ *  - text - The text of the script, modified in place
+ *  - len - The length of the text
+ * Return value : None
+ */
+static void run_script(char *text, size_t len) {
+    Cmdline **script = readscript(text, len);
+    for (size_t i = 0; script[i] != NULL; i++) {
+        if (script[i]->seq && script[i]->seq[0]) {
+            dispatchevents();  // Reap the children that terminated since the last command
+            statsstop(ST_REAP);
         }
+        run_list(script[i]);
     }
-    // Parent
-    int job_id = addjob(l->raw, pids, pids_len);
-    if (l->bg == 0)
-        setfg(job_id);
-    else if (shellprint)
-        printf("[%d] %d\n", job_id, pids[0]);
-
-    // Unblock SIGCHLD
-    Sigprocmask(SIG_SETMASK, &prev_mask, NULL);
 }
 
 
 int main(int argc, char *argv[]) {
-    // If argument is provided, read file instead of stdin and disable shell prints
-    if (argc > 1) {
+    char *script = NULL;
+    size_t script_len = 0;
+
+    // "-c string" executes the string, "file" executes the file (mapped in memory), and both disable shell prints
+    if (argc > 1 && strcmp(argv[1], "-c") == 0) {
+        if (argc < 3) {
+            fprintf(stderr, "%s: -c: option requires an argument\n", argv[0]);
+            exit(2);
+        }
+        script = argv[2];
+        script_len = strlen(script);
+    } else if (argc > 1) {
+        struct stat st;
         int fd = Open(argv[1], O_RDONLY, 0);
-        Dup2(fd, 0);
-        shellprint = 0;
+        Fstat(fd, &st);
+        // Pipes and devices cannot be mapped, read them line by line instead of stdin
+        if (!S_ISREG(st.st_mode)) {
+            Dup2(fd, 0);
+            shellprint = 0;
+        } else {
+            script_len = st.st_size;
+            // Private mapping : lines are split in place without writing to the file
+            if (script_len > 0)
+                script = Mmap(NULL, script_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+            else
+                script = argv[1] + strlen(argv[1]);  // Empty script, any empty string will do
+        }
+        Close(fd);
     }
 
-    // Disable the shell prints if stdin is not a terminal (aka is a file)
-    if (!isatty(0))
+    // Disable the shell prints if stdin is not a terminal (aka is a file), or if a script is executed
+    if (!isatty(0) || script != NULL)
         shellprint = 0;
 
+    // A builtin placed in a wrong slot would silently run the external command instead
+    if (!checkbuiltins())
+        exit(2);
+
     // Init mask
     Sigfillset(&mask_all);
+    // Internal commands executed by the shell itself may write into a tube nobody reads anymore
+    Signal(SIGPIPE, SIG_IGN);
 
-    // Init job list and signal handlers
+    // Init job list and the signalfd event loop
     initjobs();
-    Signal(SIGCHLD, handle_child);
-    Signal(SIGINT, handle_int);
-    Signal(SIGTSTP, handle_tstp);
+    setlauncher(launch_queued);
+    initevents(shellprint);
+    inittrace();
+
+    if (script != NULL) {
+        run_script(script, script_len);
+        waitqueue(); // The jobs delayed by the queue run to their end, the other ones are killed
+        killjobs(); // Kill all remaining jobs before exiting, avoids zombies
+        hashclear();
+        freecmds();
+        exit(getstatus());  // Like sh, the exit status of the last command line, for the batch runners
+    }
+
+    if (shellprint)
+        initprompt();
 
     Cmdline *l;
     while (1) {
         if (shellprint)
             show_prompt();
+        statsstop(ST_REAP);  // Ready for the next command
 
+        // Keep reaping children while waiting for the next command
+        waitinput();
         l = readcmd();
 
         // If input stream closed, normal termination
         if (!l) {
             if (shellprint)
                 printf("\n");
+            waitqueue(); // The jobs delayed by the queue run to their end, the other ones are killed
             killjobs(); // Kill all remaining jobs before exiting, avoids zombies
-            exit(0);    // No need to free l before exit, readcmd() already did it
-        }
-
-        // Syntax error, read another command
-        if (l->err) {
-            fprintf(stderr, "synthax error: %s\n", l->err);
-            continue;
+            hashclear();
+            exit(getstatus());  // No need to free l before exit, readcmd() already did it
         }
 
-        // Empty command
-        if (!l->seq[0])
-            continue;
-
-        // If internal command with no pipe, execute it directly and continue
-        if (!l->seq[1] && check_internal_commands(l, 0) == 1)
-            continue;
-
-        // Otherwise execute command with child processes
-        exec_cmd(l);
-
-        waitfgjob();
+        run_list(l);
     }
 }
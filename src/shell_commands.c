@@ -5,17 +5,31 @@
 #include <errno.h>
 #include "shell_commands.h"
 #include "jobs.h"
+#include "options.h"
+#include "cmdhash.h"
+#include "prompt.h"
+#include "stats.h"
+#include "utilities.h"
+#include "transfer.h"
+
+static int last_status = 0;  // Exit status of the last command line, "$?"
+
+// How an internal command is executed
+#define RUN_SHELL 0     // By the shell itself
+#define RUN_FORK 1      // By its own process, like the subshell of sh
+#define RUN_EXTERNAL 2  // Not at all, the external command is executed instead
 
 /* cmd_stop - Stop a job
  * Arguments :
  *  - argc - The number of arguments
  *  - args - The array of arguments
- * Return value : None
+ *  - l - The whole command line (Cmdline structure)
+ * Return value : The exit status, 0 if the job was selected
  * Notes : If no argument is given, the last background job created is selected,
  *         If one argument is given, it must be a job id (preceded by a '%') or a pid select the job
  *         If more than one argument is given, an error is printed
  */
-void cmd_stop(int argc, char *args[]) {
+static int cmd_stop(int argc, char *args[], Cmdline *l) {
     if (argc > 2)
         fprintf(stderr, "%s: too many arguments\n", args[0]);
     else {
@@ -54,19 +68,22 @@ void cmd_stop(int argc, char *args[]) {
                 printf("[%d] %d  Suspended  %s\n", job_id, getjobpgid(job_id), getjobcmd(job_id));
                 break;
         }
+        return err != 0;
     }
+    return 1;
 }
 
 /* cmd_fg - Put a job in foreground
  * Arguments :
  *  - argc - The number of arguments
  *  - args - The array of arguments
- * Return value : None
+ *  - l - The whole command line (Cmdline structure)
+ * Return value : The exit status of the job, 1 if it was not found
  * Notes : If no argument is given, the last background job created is selected,
  *         If one argument is given, it must be a job id (preceded by a '%') or a pid to select the job
  *         If more than one argument is given, an error is printed
  */
-void cmd_fg(int argc, char *args[]) {
+static int cmd_fg(int argc, char *args[], Cmdline *l) {
     if (argc > 2)
         fprintf(stderr, "%s: too many arguments\n", args[0]);
     else {
@@ -109,19 +126,22 @@ void cmd_fg(int argc, char *args[]) {
         }
 
         waitfgjob();
+        return (err == 0) ? getjobstatus(job_id) : 1;
     }
+    return 1;
 }
 
 /* cmd_bg - Put a job in background and resume it
  * Arguments :
  *  - argc - The number of arguments
  *  - args - The array of arguments
- * Return value : None
+ *  - l - The whole command line (Cmdline structure)
+ * Return value : The exit status, 0 if the job was selected
  * Notes : If no argument is given, the last background job created is selected,
  *         If one argument is given, it must be a job id (preceded by a '%') or a pid select the job
  *         If more than one argument is given, an error is printed
  */
-void cmd_bg(int argc, char *args[]) {
+static int cmd_bg(int argc, char *args[], Cmdline *l) {
     if (argc > 2)
         fprintf(stderr, "%s: too many arguments\n", args[0]);
     else {
@@ -159,34 +179,90 @@ void cmd_bg(int argc, char *args[]) {
                 printf("[%d] %d  Running    %s\n", job_id, getjobpgid(job_id), getjobcmd(job_id));
                 break;
         }
+        return err != 0;
     }
+    return 1;
 }
 
 /* cmd_jobs - Print the list of jobs
  * Arguments :
  *  - argc - The number of arguments
  *  - args - The array of arguments
- * Return value : None
- * Notes : If more than one argument is given, an error is printed
+ *  - l - The whole command line (Cmdline structure)
+ * Return value : The exit status, 0 on success
+ * Notes : "-l" also prints the resources used by each job (CPU times, max RSS and context switches)
+ *         If any other argument is given, an error is printed
  */
-void cmd_jobs(int argc, char *args[]) {
-    if (argc > 1)
+static int cmd_jobs(int argc, char *args[], Cmdline *l) {
+    if (argc > 2)
         fprintf(stderr, "%s: too many arguments\n", args[0]);
-    else
-        printjobs();
+    else if (argc == 2 && strcmp(args[1], "-l") != 0)
+        fprintf(stderr, "%s: %s: invalid option\n", args[0], args[1]);
+    else {
+        printjobs(argc == 2);
+        return 0;
+    }
+    return 1;
+}
+
+/* cmd_wait - Wait for background jobs
+ * Arguments :
+ *  - argc - The number of arguments
+ *  - args - The array of arguments
+ *  - l - The whole command line (Cmdline structure)
+ * Return value : The exit status of the last job waited for, 127 if it was not found, 0 if no argument is given, 2 if
+ *                "-n" is followed by other arguments
+ * Notes : If no argument is given, every job is waited for, including the queued ones, but not the stopped ones
+ *         If the argument is "-n", the first job to finish is waited for
+ *         Otherwise each argument must be a job id (preceded by a '%') or a pid to select a job to wait for
+ */
+static int cmd_wait(int argc, char *args[], Cmdline *l) {
+    int status = 0;
+    if (argc == 1)
+        waitjobs();
+    else if (strcmp(args[1], "-n") == 0) {
+        int job_id;
+        if (argc > 2) {
+            fprintf(stderr, "%s: too many arguments\n", args[0]);
+            status = 2;  // Usage error, like the builtins of bash
+        } else if ((status = waitanyjob(&job_id)) == -1)
+            status = 127;  // No job to wait for
+    }
+
+    for (int i = 1; i < argc && strcmp(args[1], "-n") != 0; i++) {
+        int job_id = -1;
+        if (args[i][0] == '%') {
+            // If the argument is not just "%", and is a positive integer
+            if (strlen(args[i]) > 1 && '0' <= args[i][1] && args[i][1] <= '9')
+                job_id = atoi(args[i] + 1);
+            else
+                fprintf(stderr, "%s: invalid job id\n", args[0]);
+        } else if ('0' <= args[i][0] && args[i][0] <= '9') // Otherwise it must be a positive integer
+            job_id = getjob(atoi(args[i]));
+        else
+            fprintf(stderr, "%s: invalid pid\n", args[0]);
+
+        if ((status = waitjob(job_id)) == -1) {
+            fprintf(stderr, "%s: %s: No such job\n", args[0], args[i]);
+            status = 127;
+        }
+    }
+    return status;
 }
 
 /* cmd_cd - Change the directory
  * Arguments :
  *  - argc - The number of arguments
  *  - args - The array of arguments
- * Return value : None
+ *  - l - The whole command line (Cmdline structure)
+ * Return value : The exit status, 0 on success
  * Notes : If no argument is given, the home directory is used
  *         If one argument is given, it will try to go to the given destination and change the PWD env variable
  *         If more than one argument is given, an error is printed
  */
-void cmd_cd(int argc, char *args[]) {
+static int cmd_cd(int argc, char *args[], Cmdline *l) {
     char *pwd;
+    int status = 1;
 
     if (argc > 2)
         fprintf(stderr, "%s: too many arguments\n", args[0]);
@@ -197,78 +273,346 @@ void cmd_cd(int argc, char *args[]) {
         if (errno == 14)
             goto noerrno;
         perror(args[0]);
-    }
+    } else
+        status = 0;
 
     noerrno:
-    // Update PWD env variable
+    // Update PWD env variable and the prompt, which never queries the current directory itself
     pwd = getcwd(NULL, 0);
-    setenv("PWD", pwd, 1);
+    if (pwd != NULL)
+        setenv("PWD", pwd, 1);
+    setpromptcwd(pwd);
     free(pwd);
+    return status;
 }
 
-/* check_internal_commands - Check if the command is an internal command and execute it if it is
+/* cmd_setopt - Print or change the shell options
  * Arguments :
+ *  - argc - The number of arguments
+ *  - args - The array of arguments
  *  - l - The whole command line (Cmdline structure)
- *  - cmd_index - The index of the command in the command line
- * Return value : 1 if the command is an internal command, 0 otherwise
- * Notes : If the command is "exit" or "quit", it may not return any value and exit the shell with the given exit code
+ * Return value : The exit status, 0 on success
+ * Notes : If no argument is given, all the options are printed with their values,
+ *         Otherwise each argument must be of the form "name=value"
  */
-int check_internal_commands(Cmdline *l, int cmd_index) {
-    char **cmd = l->seq[cmd_index];
+static int cmd_setopt(int argc, char *args[], Cmdline *l) {
+    int status = 0;
+    if (argc == 1)
+        printoptions();
 
-    int argc = 1;
-    while (cmd[argc] != NULL)
-        argc++;
+    for (int i = 1; i < argc; i++) {
+        switch (setoption(args[i])) {
+            case 2:
+                fprintf(stderr, "%s: %s: invalid value\n", args[0], args[i]);
+                status = 1;
+                break;
+            case 1:
+                fprintf(stderr, "%s: %s: no such option\n", args[0], args[i]);
+                status = 1;
+                break;
+            case 0:
+            default:
+                break;
+        }
+    }
+    return status;
+}
 
-    // Command is "exit" or "quit" (not in a function because of freecmd2(l))
-    if (strcmp(cmd[0], "exit") == 0 || strcmp(cmd[0], "quit") == 0) {
-        if (argc > 2)
-            fprintf(stderr, "%s: too many arguments\n", cmd[0]);
+/* cmd_shstats - Print or reset the statistics of the shell about itself
+ * Arguments :
+ *  - argc - The number of arguments
+ *  - args - The array of arguments
+ *  - l - The whole command line (Cmdline structure)
+ * Return value : The exit status, 0 on success
+ * Notes : "-j" prints them as JSON, "-r" resets them after printing them, any other argument is an error
+ */
+static int cmd_shstats(int argc, char *args[], Cmdline *l) {
+    int json = 0, reset = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(args[i], "-j") == 0)
+            json = 1;
+        else if (strcmp(args[i], "-r") == 0)
+            reset = 1;
         else {
-            int code = 0;
-            // If there is an argument, use it as exit code, otherwise use 0 by default
-            if (argc == 2)
-                code = atoi(cmd[1]);  // RED SECURITY ALERT : atoi not safe !!! :)
-            freecmd2(l);
-            killjobs();
-            exit(code);
+            fprintf(stderr, "%s: %s: invalid option\n", args[0], args[i]);
+            return 1;
         }
     }
+    printstats(json);
+    if (reset)
+        resetstats();
+    return 0;
+}
 
-    // Command is "cd"
-    if (strcmp(cmd[0], "cd") == 0) {
-        cmd_cd(argc, cmd);
-        return 1;
+/* cmd_hash - Print or change the remembered paths of the external commands
+ * Arguments :
+ *  - argc - The number of arguments
+ *  - args - The array of arguments
+ *  - l - The whole command line (Cmdline structure)
+ * Return value : The exit status, 0 on success
+ * Notes : If no argument is given, the remembered commands are printed with their number of hits,
+ *         If the argument is "-r", every remembered path is forgotten,
+ *         Otherwise each argument is a command whose path is searched and remembered
+ */
+static int cmd_hash(int argc, char *args[], Cmdline *l) {
+    int status = 0;
+    if (argc == 1)
+        printhash();
+    else if (strcmp(args[1], "-r") == 0) {
+        if (argc > 2) {
+            fprintf(stderr, "%s: too many arguments\n", args[0]);
+            status = 1;
+        } else
+            hashclear();
+    } else {
+        for (int i = 1; i < argc; i++) {
+            if (hashlookup(args[i]) == NULL) {
+                fprintf(stderr, "%s: %s: not found\n", args[0], args[i]);
+                status = 1;
+            }
+        }
     }
+    return status;
+}
 
-    // Command is "jobs"
-    if (strcmp(cmd[0], "jobs") == 0) {
-        cmd_jobs(argc, cmd);
-        return 1;
-    }
 
-    // Command is "fg"
-    if (strcmp(cmd[0], "fg") == 0) {
-        cmd_fg(argc, cmd);
+/* cmd_exit - Exit the shell, killing every job
+ * Arguments :
+ *  - argc - The number of arguments
+ *  - args - The array of arguments
+ *  - l - The whole command line (Cmdline structure)
+ * Return value : The exit status, 1 if too many arguments are given, it does not return otherwise
+ * Notes : If an argument is given, it is the exit code of the shell, otherwise the exit status of the last command line
+ *         is used
+ */
+static int cmd_exit(int argc, char *args[], Cmdline *l) {
+    if (argc > 2) {
+        fprintf(stderr, "%s: too many arguments\n", args[0]);
         return 1;
     }
 
-    // Command is "bg"
-    if (strcmp(cmd[0], "bg") == 0) {
-        cmd_bg(argc, cmd);
-        return 1;
-    }
+    int code = last_status;
+    if (argc == 2)
+        code = atoi(args[1]);  // RED SECURITY ALERT : atoi not safe !!! :)
+    freecmds();  // l is freed as well
+    killjobs();
+    hashclear();
+    exit(code);
+}
 
-    // Command is "stop"
-    if (strcmp(cmd[0], "stop") == 0) {
-        cmd_stop(argc, cmd);
-        return 1;
+/* cmd_comment - Ignore a comment (for tests purposes)
+ * Arguments : Ignored
+ * Return value : The exit status of the last command line, left unchanged
+ */
+static int cmd_comment(int argc, char *args[], Cmdline *l) {
+    return last_status;
+}
+
+/* forkalways - Tell how relay is executed
+ * Arguments :
+ *  - args - The array of arguments
+ *  - last - Unused
+ * Return value : RUN_FORK, it always reads its standard input
+ */
+static int forkalways(char *args[], int last) {
+    return RUN_FORK;
+}
+
+/* lastonly - Tell how the builtins changing the state of the shell (cd, exit, setopt) or waiting for its jobs (fg, wait)
+ *            are executed, a builtin waiting for the job of its own tube would never let it end
+ * Arguments :
+ *  - args - The array of arguments
+ *  - last - 1 if the command is the last one of its command line, 0 otherwise
+ * Return value : RUN_SHELL for the last command, like the "lastpipe" option of bash, RUN_FORK otherwise
+ */
+static int lastonly(char *args[], int last) {
+    return last ? RUN_SHELL : RUN_FORK;
+}
+
+/* catmode - Tell how cat is executed
+ * Arguments :
+ *  - args - The array of arguments
+ *  - last - 1 if the command is the last one of its command line, 0 otherwise
+ * Return value : RUN_EXTERNAL if an option is not supported by util_cat(), RUN_FORK if it reads its standard input or
+ *                if it writes into a tube, RUN_SHELL otherwise
+ * Notes : The shell only reads its signals between the command lines, a terminal could be read forever, and a slow
+ *         reader could block the write into a tube, without letting SIGINT interrupt it. The files are not checked
+ *         here, they could be replaced before being opened : util_cat() forks once it has opened a file that is not
+ *         a regular one, or if its output is not a regular file
+ */
+static int catmode(char *args[], int last) {
+    int i = 1, mode = last ? RUN_SHELL : RUN_FORK;
+
+    if (args[i] != NULL && strcmp(args[i], "-u") == 0)
+        i++;
+    if (args[i] == NULL)
+        return RUN_FORK;
+    for (; args[i] != NULL; i++) {
+        if (strcmp(args[i], "-") == 0)
+            mode = RUN_FORK;
+        else if (args[i][0] == '-')
+            return RUN_EXTERNAL;
     }
+    return mode;
+}
 
-    // Ignore comments (for tests purposes)
-    if (cmd[0][0] == '#') {
-        return 1;
+typedef int (*Builtin)(int argc, char *args[], Cmdline *l);
+
+// Entry of the table of the builtins
+typedef struct _builtinentry {
+    char *name;                  // Name of the builtin, NULL if the slot is empty
+    Builtin run;                 // Function executing it
+    int (*mode)(char *args[], int last);  // Function telling how a command is executed (RUN_* constants), NULL to
+                                          // always execute it in the shell itself
+} BuiltinEntry;
+
+#define MIN_NAME_LENGTH 1
+#define MAX_NAME_LENGTH 7
+#define MAX_HASH_VALUE 28
+
+/* Association values of the characters for findentry(), chosen (like gperf does) so that every builtin gets its own
+ * slot in the table. Adding a builtin requires choosing them again, the slot of each name is given in the table, and
+ * checkbuiltins() stops the shell at startup if a name is not found in its own slot.
+ */
+static const unsigned char asso_values[256] = {
+        ['['] = 12, ['\\'] = 12, ['b'] = 1, ['c'] = 18, ['f'] = 6, ['g'] = 3, ['h'] = 2, ['i'] = 9, ['j'] = 9, ['p'] = 5,
+        ['q'] = 1, ['r'] = 1, ['s'] = 11, ['t'] = 8, ['u'] = 7, ['w'] = 11,
+};
+
+// The builtins, indexed by the hash of their name, the utilities (see utilities.h) are only matched by name so an
+// explicit path like "/bin/echo" still executes the external one
+static const BuiltinEntry builtins[MAX_HASH_VALUE + 1] = {
+        [5] = {"bg", cmd_bg},
+        [6] = {"relay", util_relay, forkalways},
+        [9] = {"echo", util_echo},
+        [10] = {"fg", cmd_fg, lastonly},
+        [11] = {"exit", cmd_exit, lastonly},
+        [12] = {"quit", cmd_exit, lastonly},
+        [14] = {"printf", util_printf},
+        [15] = {"hash", cmd_hash},
+        [16] = {"stop", cmd_stop},
+        [17] = {"false", util_false},
+        [18] = {"true", util_true},
+        [19] = {"test", util_test},
+        [20] = {"cd", cmd_cd, lastonly},
+        [21] = {"jobs", cmd_jobs},
+        [22] = {"wait", cmd_wait, lastonly},
+        [24] = {"setopt", cmd_setopt, lastonly},
+        [25] = {"[", util_test},
+        [26] = {"shstats", cmd_shstats},
+        [28] = {"cat", util_cat, catmode},
+};
+
+/* findentry - Find the entry of a command name in the table of the builtins, with a single string comparison
+ * Arguments :
+ *  - name - The name of the command (first word of the command)
+ * Return value : A pointer to the entry
+ *                NULL if the command is not a builtin, or is a comment
+ * Notes : The slot of a name is its length plus the association value of its first character, plus the association
+ *         value of the successor of its last character in the ASCII table (name[len - 1] + 1, e.g. 'e' for "cd"), not
+ *         of the terminating null byte
+ */
+static const BuiltinEntry *findentry(char *name) {
+    size_t len = strlen(name);
+    if (len < MIN_NAME_LENGTH || len > MAX_NAME_LENGTH)
+        return NULL;
+    size_t key = len + asso_values[(unsigned char) name[0]] + asso_values[(unsigned char) (name[len - 1] + 1)];
+    if (key > MAX_HASH_VALUE || builtins[key].name == NULL || strcmp(name, builtins[key].name) != 0)
+        return NULL;
+    return &builtins[key];
+}
+
+/* checkbuiltins - Check that the hash of the name of every builtin leads to its own entry
+ * Arguments : None
+ * Return value : 1 if every builtin is found, 0 otherwise (an error is printed for each misplaced builtin)
+ * Notes : The association values of the hash are chosen by hand, a new builtin could be placed in a wrong slot
+ */
+int checkbuiltins() {
+    int ok = 1;
+    for (size_t key = 0; key <= MAX_HASH_VALUE; key++) {
+        if (builtins[key].name != NULL && findentry(builtins[key].name) != &builtins[key]) {
+            fprintf(stderr, "shell: the builtin %s is not found in its slot %zu\n", builtins[key].name, key);
+            ok = 0;
+        }
     }
+    return ok;
+}
 
-    return 0;
+/* findbuiltin - Find the builtin executing a command
+ * Arguments :
+ *  - cmd - The words of the command
+ * Return value : The function executing the builtin
+ *                NULL if the command is not a builtin, or if the external command must be executed instead
+ */
+static Builtin findbuiltin(char *cmd[]) {
+    // Comments are handled as internal commands as well
+    if (cmd[0][0] == '#')
+        return cmd_comment;
+
+    const BuiltinEntry *entry = findentry(cmd[0]);
+    if (entry == NULL || (entry->mode != NULL && entry->mode(cmd, 1) == RUN_EXTERNAL))
+        return NULL;
+    return entry->run;
+}
+
+/* isinternal - Tell whether a command is executed by an internal command
+ * Arguments :
+ *  - cmd - The words of the command
+ * Return value : 1 if the command is an internal command, 0 otherwise
+ */
+int isinternal(char *cmd[]) {
+    return findbuiltin(cmd) != NULL;
+}
+
+/* mustfork - Tell whether an internal command must be executed by its own process, even in foreground
+ * Arguments :
+ *  - cmd - The words of the command
+ *  - last - 1 if the command is the last one of its command line, 0 otherwise
+ * Return value : 1 if the mode of the builtin asks for its own process (it reads its standard input, writes into a
+ *                tube, or changes the state of the shell without being the last command), 0 otherwise (or if it is not
+ *                an internal command)
+ */
+int mustfork(char *cmd[], int last) {
+    const BuiltinEntry *entry = findentry(cmd[0]);
+    return entry != NULL && entry->mode != NULL && entry->mode(cmd, last) == RUN_FORK;
+}
+
+/* getstatus - Get the exit status of the last command line, "$?"
+ * Arguments : None
+ * Return value : The exit status
+ */
+int getstatus() {
+    return last_status;
+}
+
+/* setstatus - Set the exit status of the last command line, "$?"
+ * Arguments :
+ *  - status - The exit status
+ * Return value : None
+ */
+void setstatus(int status) {
+    last_status = status;
+}
+
+/* check_internal_commands - Check if the command is an internal command and execute it if it is
+ * Arguments :
+ *  - l - The whole command line (Cmdline structure)
+ *  - cmd_index - The index of the command in the command line
+ *  - status - Filled with the exit status of the internal command, if it is one
+ * Return value : 1 if the command is an internal command, 0 otherwise
+ * Notes : If the command is "exit" or "quit", it may not return any value and exit the shell with the given exit code,
+ *         or with the exit status of the last command line by default
+ */
+int check_internal_commands(Cmdline *l, int cmd_index, int *status) {
+    char **cmd = l->seq[cmd_index];
+    Builtin run = findbuiltin(cmd);
+    if (run == NULL)
+        return 0;
+
+    // The arguments are only counted for the builtins
+    int argc = 1;
+    while (cmd[argc] != NULL)
+        argc++;
+    *status = run(argc, cmd, l);
+    return 1;
 }
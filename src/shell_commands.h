@@ -3,6 +3,16 @@
 
 #include "readcmd.h"
 
-int check_internal_commands(Cmdline *l, int cmd_index);
+int check_internal_commands(Cmdline *l, int cmd_index, int *status);
+
+int getstatus(void);
+
+void setstatus(int status);
+
+int isinternal(char *cmd[]);
+
+int mustfork(char *cmd[], int last);
+
+int checkbuiltins(void);
 
 #endif //TP_SHELL_SR_2023_SHELL_COMMANDS_H
@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "stats.h"
+
+#define NB_BUCKETS 48  // Bucket i holds the values in [2^(i-1), 2^i[, bucket 0 holds 0 (and negative values), the
+                       // last one also holds every bigger value
+
+typedef struct _histogram {
+    char *name;                     // Name printed by shstats
+    char *unit;                     // Unit of the values, "ns" for durations
+    long long start;                // Time at which the current duration was started, 0 if none
+    long long count;                // Number of values recorded
+    long long sum;                  // Sum of the values
+    long long min;                  // Lowest value
+    long long max;                  // Highest value
+    long long buckets[NB_BUCKETS];  // Number of values in each bucket
+} Histogram;
+
+// Indexed by the ST_* constants
+static Histogram stats[NB_STATS] = {
+        [ST_PARSE] = {"parse", "ns"},
+        [ST_LAUNCH] = {"launch", "ns"},
+        [ST_REAP] = {"reap_to_prompt", "ns"},
+        [ST_CHILD] = {"children_per_sigchld", "children"},
+        [ST_JOBS] = {"job_table_size", "jobs"},
+};
+
+/* now - Get the current monotonic time
+ * Arguments : None
+ * Return value : The time in nanoseconds
+ */
+static long long now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* bucket - Get the bucket of a value
+ * Arguments :
+ *  - value - The value
+ * Return value : The index of the bucket, the number of significant bits of the value
+ */
+static int bucket(long long value) {
+    if (value <= 0)
+        return 0;
+    return 64 - __builtin_clzll((unsigned long long) value);
+}
+
+// Public functions : see stats.h for documentation
+// The shell has a single thread and no signal handler (see events.h), so the histograms need no locking at all
+
+void statsstart(int stat) {
+    stats[stat].start = now();
+}
+
+void statsstop(int stat) {
+    if (stats[stat].start == 0)
+        return;
+    statsrecord(stat, now() - stats[stat].start);
+    stats[stat].start = 0;
+}
+
+void statsrecord(int stat, long long value) {
+    Histogram *h = &stats[stat];
+    if (h->count == 0 || value < h->min)
+        h->min = value;
+    if (h->count == 0 || value > h->max)
+        h->max = value;
+    h->count++;
+    h->sum += value;
+    int b = bucket(value);
+    h->buckets[b < NB_BUCKETS ? b : NB_BUCKETS - 1]++;
+}
+
+void resetstats() {
+    for (int i = 0; i < NB_STATS; i++) {
+        Histogram *h = &stats[i];
+        h->count = h->sum = h->min = h->max = 0;
+        memset(h->buckets, 0, sizeof(h->buckets));
+    }
+}
+
+void printstats(int json) {
+    if (json)
+        printf("{");
+    for (int i = 0; i < NB_STATS; i++) {
+        Histogram *h = &stats[i];
+        if (json) {
+            // Buckets are given by their lowest value, the empty ones are left out
+            printf("%s\"%s\":{\"unit\":\"%s\",\"count\":%lld,\"sum\":%lld,\"min\":%lld,\"max\":%lld,\"buckets\":[",
+                   i ? "," : "", h->name, h->unit, h->count, h->sum, h->min, h->max);
+            for (int b = 0, first = 1; b < NB_BUCKETS; b++) {
+                if (h->buckets[b] == 0)
+                    continue;
+                printf("%s[%lld,%lld]", first ? "" : ",", b ? 1LL << (b - 1) : 0, h->buckets[b]);
+                first = 0;
+            }
+            printf("]}");
+            continue;
+        }
+
+        printf("%s (%s) : count %lld", h->name, h->unit, h->count);
+        if (h->count != 0)
+            printf(", min %lld, mean %lld, max %lld", h->min, h->sum / h->count, h->max);
+        printf("\n");
+        for (int b = 0; b < NB_BUCKETS; b++)
+            if (h->buckets[b] != 0)
+                printf("  %12lld - %-12lld %10lld\n", b ? 1LL << (b - 1) : 0, b ? (1LL << b) - 1 : 0, h->buckets[b]);
+    }
+    if (json)
+        printf("}\n");
+}
@@ -0,0 +1,52 @@
+#ifndef TP_SHELL_SR_2023_STATS_H
+#define TP_SHELL_SR_2023_STATS_H
+
+/* Self instrumentation of the shell : histograms of the durations (and sizes) of its hot paths, printed by the
+ * "shstats" internal command. Every histogram has fixed power of 2 buckets, so recording a value never allocates.
+ */
+
+#define ST_PARSE 0   // Time to parse a command line in readcmd() or readscript()
+#define ST_LAUNCH 1  // Time to launch one stage of a command line (fork() or posix_spawn())
+#define ST_REAP 2    // Time from the termination of the foreground job to the next prompt (or command of a script)
+#define ST_CHILD 3   // Number of children that changed state per SIGCHLD read from the signalfd
+#define ST_JOBS 4    // Number of jobs in the job table, each time a job is added
+#define NB_STATS 5
+
+/* statsstart - Start timing a duration
+ * Arguments :
+ *  - stat - The histogram of the duration (one of the ST_* constants)
+ * Return value : None
+ * Notes : Starting again before statsstop() restarts the timing
+ */
+void statsstart(int stat);
+
+/* statsstop - Record the time elapsed since statsstart()
+ * Arguments :
+ *  - stat - The histogram of the duration (one of the ST_* constants)
+ * Return value : None
+ * Notes : Nothing is recorded if the timing was not started, or was already stopped
+ */
+void statsstop(int stat);
+
+/* statsrecord - Record a value
+ * Arguments :
+ *  - stat - The histogram of the value (one of the ST_* constants)
+ *  - value - The value, a number of nanoseconds for durations
+ * Return value : None
+ */
+void statsrecord(int stat, long long value);
+
+/* resetstats - Empty every histogram
+ * Arguments : None
+ * Return value : None
+ */
+void resetstats(void);
+
+/* printstats - Print every histogram (like the "shstats" command)
+ * Arguments :
+ *  - json - 1 to print them as a JSON object, 0 to print them for a human
+ * Return value : None
+ */
+void printstats(int json);
+
+#endif //TP_SHELL_SR_2023_STATS_H
@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "trace.h"
+#include "csapp.h"
+
+#define TRACE_BUF_SIZE 65536  // Size of the event buffer
+#define EVENT_MAX 1024        // Maximum size of one event, longer command lines are cut
+
+static int tracefd = -1;             // Global variable : trace file, -1 if tracing is disabled
+static pid_t tracepid;               // Pid of the shell, the only process allowed to write the trace
+static char tracebuf[TRACE_BUF_SIZE];
+static size_t tracelen;              // Number of bytes in the buffer
+
+/* timestamp - Get the current monotonic time
+ * Arguments : None
+ * Return value : The time in nanoseconds
+ */
+static long long timestamp() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* escape - Copy a string as the content of a JSON string
+ * Arguments :
+ *  - dst - The destination, of at least size bytes
+ *  - src - The string to copy
+ *  - size - The size of the destination, the string is cut if it does not fit
+ * Return value : None
+ */
+static void escape(char *dst, char *src, size_t size) {
+    size_t len = 0;
+    for (; *src != 0 && len + 7 < size; src++) {
+        unsigned char c = *src;
+        if (c == '"' || c == '\\') {
+            dst[len++] = '\\';
+            dst[len++] = c;
+        } else if (c < 0x20)
+            len += sprintf(dst + len, "\\u%04x", c);
+        else
+            dst[len++] = c;
+    }
+    dst[len] = 0;
+}
+
+/* emit - Add an event to the buffer, flushing it first if there is not enough room
+ * Arguments :
+ *  - format - The printf format of the event, without the separator
+ *  - ... - The arguments of the format
+ * Return value : None
+ */
+static void emit(char *format, ...) {
+    va_list ap;
+    if (tracelen + EVENT_MAX + 2 > TRACE_BUF_SIZE)
+        traceflush();
+
+    tracebuf[tracelen++] = ',';  // The array was opened with a first event, so every other one follows a comma
+    tracebuf[tracelen++] = '\n';
+    va_start(ap, format);
+    int n = vsnprintf(tracebuf + tracelen, EVENT_MAX, format, ap);
+    va_end(ap);
+    tracelen += (n < EVENT_MAX) ? n : EVENT_MAX - 1;
+}
+
+/* beginstate - Begin the slice of a state on the track of a process
+ * Arguments :
+ *  - pid - The pid of the process
+ *  - state - The name of the state
+ *  - ts - The timestamp of the beginning of the slice, in nanoseconds
+ * Return value : None
+ */
+static void beginstate(pid_t pid, char *state, long long ts) {
+    emit("{\"name\":\"%s\",\"cat\":\"process\",\"ph\":\"B\",\"ts\":%lld.%03lld,\"pid\":%d,\"tid\":%d}",
+         state, ts / 1000, ts % 1000, tracepid, pid);
+}
+
+/* endtrace - Complete and close the trace file, registered with atexit()
+ * Arguments : None
+ * Return value : None
+ */
+static void endtrace() {
+    if (tracefd < 0 || getpid() != tracepid)
+        return;  // Forked children exit without touching the trace of the shell
+    memcpy(tracebuf + tracelen, "\n]\n", 3);
+    tracelen += 3;
+    traceflush();
+    close(tracefd);
+    tracefd = -1;
+}
+
+// Public functions : see trace.h for documentation
+
+void inittrace() {
+    char *path = getenv("SHELL_TRACE");
+    if (path == NULL || *path == 0)
+        return;
+    if ((tracefd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0) {
+        perror(path);
+        return;
+    }
+    tracepid = getpid();
+    tracelen = sprintf(tracebuf, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                                 "\"args\":{\"name\":\"shell\"}}", tracepid, tracepid);
+    atexit(endtrace);
+}
+
+void tracejob(int job_id, char *cmd, int begin) {
+    if (tracefd < 0)
+        return;
+    char name[EVENT_MAX / 2];
+    escape(name, cmd, sizeof(name));
+    long long ts = timestamp();
+    emit("{\"name\":\"[%d] %s\",\"cat\":\"job\",\"ph\":\"%c\",\"id\":%d,\"ts\":%lld.%03lld,\"pid\":%d,\"tid\":%d}",
+         job_id, name, begin ? 'b' : 'e', job_id, ts / 1000, ts % 1000, tracepid, tracepid);
+}
+
+void tracestage(pid_t pid, int job_id, char *name) {
+    if (tracefd < 0)
+        return;
+    char escaped[EVENT_MAX / 2];
+    escape(escaped, name, sizeof(escaped));
+    emit("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"[%d] %d %s\"}}",
+         tracepid, pid, job_id, pid, escaped);
+    beginstate(pid, "Running", timestamp());
+}
+
+void tracestate(pid_t pid, char *state) {
+    if (tracefd < 0)
+        return;
+    long long ts = timestamp();
+    // A process is always in the slice of its previous state, opened by tracestage() or by a previous call
+    emit("{\"ph\":\"E\",\"ts\":%lld.%03lld,\"pid\":%d,\"tid\":%d}", ts / 1000, ts % 1000, tracepid, pid);
+    if (state != NULL)
+        beginstate(pid, state, ts);
+}
+
+void traceflush() {
+    if (tracefd < 0 || getpid() != tracepid)
+        return;
+    if (rio_writen(tracefd, tracebuf, tracelen) < 0) {
+        perror("trace");
+        close(tracefd);
+        tracefd = -1;  // Tracing is disabled rather than stopping the shell
+    }
+    tracelen = 0;
+}
@@ -0,0 +1,52 @@
+#ifndef TP_SHELL_SR_2023_TRACE_H
+#define TP_SHELL_SR_2023_TRACE_H
+
+#include <sys/types.h>
+
+/* Opt-in tracing of the jobs, written in the Chrome trace event format (open it with Perfetto or chrome://tracing).
+ * Tracing is enabled by the SHELL_TRACE environment variable, set to the path of the trace file. Each job is an async
+ * slice of the shell process, and each process of a job has its own track, with a slice per state (Running/Stopped).
+ * Events are written to a fixed buffer and only written to the file when it is full, or by traceflush().
+ * Every function does nothing if tracing is disabled.
+ */
+
+/* inittrace - Open the trace file if tracing is enabled
+ * Arguments : None
+ * Return value : None
+ * Notes : The trace is flushed and completed automatically when the shell exits, but not when its children exit
+ */
+void inittrace(void);
+
+/* tracejob - Trace the beginning or the end of a Job
+ * Arguments :
+ *  - job_id - The id of the Job
+ *  - cmd - The command line of the Job
+ *  - begin - 1 if the Job begins, 0 if it ends
+ * Return value : None
+ */
+void tracejob(int job_id, char *cmd, int begin);
+
+/* tracestage - Trace the launch of a process of a Job, which gets its own track
+ * Arguments :
+ *  - pid - The pid of the process
+ *  - job_id - The id of its Job
+ *  - name - The name of the command executed by the process
+ * Return value : None
+ */
+void tracestage(pid_t pid, int job_id, char *name);
+
+/* tracestate - Trace a change of state of a process
+ * Arguments :
+ *  - pid - The pid of the process
+ *  - state - The name of the new state ("Running", "Stopped"), NULL if the process terminated
+ * Return value : None
+ */
+void tracestate(pid_t pid, char *state);
+
+/* traceflush - Write the buffered events to the trace file
+ * Arguments : None
+ * Return value : None
+ */
+void traceflush(void);
+
+#endif //TP_SHELL_SR_2023_TRACE_H
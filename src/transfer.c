@@ -0,0 +1,249 @@
+#define _GNU_SOURCE  // splice(), tee(), copy_file_range(), F_SETPIPE_SZ, which csapp.h cannot be compiled with
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <sys/wait.h>
+#include "transfer.h"
+#include "events.h"
+
+#define CHUNK (1 << 30)     // Bytes asked to each system call, they stop at the content of the tube anyway
+#define BUF_SIZE (1 << 20)  // Size of the buffer of copyuser()
+
+/* writeall - Write a whole buffer, like rio_writen()
+ * Arguments :
+ *  - fd - The fd to write
+ *  - buf - The buffer
+ *  - n - The number of bytes to write
+ * Return value : 0 if everything was written, -1 on an error (errno is set)
+ */
+static int writeall(int fd, char *buf, size_t n) {
+    while (n > 0) {
+        ssize_t written = write(fd, buf, n);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written < 0)
+            return -1;
+        buf += written;
+        n -= written;
+    }
+    return 0;
+}
+
+/* copyuser - Copy everything from one fd to another, and to a file, through a buffer in userspace
+ * Arguments :
+ *  - in - The fd to read
+ *  - out - The fd to write
+ *  - file - Another fd to write, -1 if none
+ * Return value : 0 once the end of in was reached, -1 on an error (errno is set)
+ */
+static int copyuser(int in, int out, int file) {
+    char *buf = (char *) malloc(BUF_SIZE);  // Not kept by the shell, which may execute cat itself
+    ssize_t n;
+
+    if (buf == NULL)
+        return -1;
+    // Not rio_readn(), which would wait for a full buffer before passing anything on
+    while ((n = read(in, buf, BUF_SIZE)) != 0) {
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 || writeall(out, buf, n) < 0 || (file != -1 && writeall(file, buf, n) < 0))
+            break;
+    }
+    free(buf);
+    return (n == 0) ? 0 : -1;
+}
+
+/* transfer - Copy everything from one fd to another, inside the kernel whenever possible
+ * Arguments :
+ *  - in - The fd to read
+ *  - out - The fd to write
+ * Return value : Same as copyuser()
+ * Notes : copy_file_range() is used between regular files (the file system may even share their blocks), sendfile()
+ *         from a regular file, splice() if an end is a tube, and copyuser() otherwise, or if the kernel refuses
+ */
+static int transfer(int in, int out) {
+    struct stat sin, sout;
+    int copied = 0;
+
+    if (fstat(in, &sin) < 0 || fstat(out, &sout) < 0)
+        return -1;
+    int regular = S_ISREG(sin.st_mode), tube = S_ISFIFO(sin.st_mode) || S_ISFIFO(sout.st_mode);
+    if (!regular && !tube)
+        return copyuser(in, out, -1);
+
+    for (;;) {
+        ssize_t n;
+        if (regular && S_ISREG(sout.st_mode))
+            n = copy_file_range(in, NULL, out, NULL, CHUNK, 0);
+        else if (regular)
+            n = sendfile(out, in, NULL, CHUNK);
+        else
+            n = splice(in, NULL, out, NULL, CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (n == 0)
+            return 0;
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0) {
+            // Unsupported by the file systems or the kind of fds, detected by the first call (EBADF for an output
+            // opened with O_APPEND)
+            if (!copied && (errno == EINVAL || errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP ||
+                            errno == EBADF))
+                return copyuser(in, out, -1);
+            return -1;
+        }
+        copied = 1;
+    }
+}
+
+/* relay - Copy everything from one fd to another, and to a file, with splice() and tee()
+ * Arguments : Same as copyuser()
+ * Return value : Same as copyuser()
+ * Notes : tee() gives the bytes at the head of the input tube to out without consuming them, splice() then moves the
+ *         same bytes into the file. copyuser() takes over if the ends are not tubes, transfer() if there is no file
+ */
+static int relay(int in, int out, int file) {
+    if (file == -1)
+        return transfer(in, out);
+
+    for (;;) {
+        ssize_t n = tee(in, out, CHUNK, 0);
+        if (n == 0)
+            return 0;
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return (errno == EINVAL) ? copyuser(in, out, file) : -1;
+
+        while (n > 0) {
+            ssize_t moved = splice(in, NULL, file, NULL, n, SPLICE_F_MOVE);
+            if (moved < 0 && errno == EINTR)
+                continue;
+            if (moved <= 0)
+                return -1;
+            n -= moved;
+        }
+    }
+}
+
+void settubesize(int fd, long size) {
+    fcntl(fd, F_SETPIPE_SZ, (int) size);
+}
+
+int util_relay(int argc, char *args[], Cmdline *l) {
+    int file = -1, status = 0;
+
+    if (argc > 2) {
+        fprintf(stderr, "%s: too many arguments\n", args[0]);
+        return 1;
+    }
+    if (argc == 2 && (file = open(args[1], O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0) {
+        perror(args[1]);
+        return 1;
+    }
+    if (relay(0, 1, file) < 0) {
+        perror(args[0]);
+        status = 1;
+    }
+    if (file != -1)
+        close(file);
+    return status;
+}
+
+/* inshell - Tell whether a utility is executed by the shell itself
+ * Arguments : None
+ * Return value : 1 if SIGINT is blocked, the shell only reads it from its signalfd between the command lines, so a
+ *                blocking system call could not be interrupted, 0 otherwise (forked, SIGINT is delivered)
+ */
+static int inshell() {
+    sigset_t set;
+    sigprocmask(SIG_BLOCK, NULL, &set);
+    return sigismember(&set, SIGINT);
+}
+
+/* forkcat - Copy the files left by cat in a child process, waited by the shell
+ * Arguments :
+ *  - argc - The number of arguments of cat
+ *  - args - The array of arguments of cat
+ *  - i - The index of the first file left, lower than argc
+ * Return value : The exit status of the child, 128 + the signal that killed it
+ * Notes : The child receives SIGINT (see waitchild()), what could block, like a write into a terminal or a device, does
+ *         not block the shell
+ */
+static int forkcat(int argc, char *args[], int i) {
+    pid_t pid;
+    sigset_t intmask;
+
+    fflush(stdout);
+    if ((pid = fork()) < 0) {
+        fprintf(stderr, "%s: %s\n", args[0], strerror(errno));
+        return 1;
+    }
+    if (pid == 0) {
+        char *files[argc - i + 2];
+        files[0] = args[0];
+        memcpy(files + 1, args + i, sizeof(char *) * (argc - i));
+        files[argc - i + 1] = NULL;
+
+        // SIGTSTP stays blocked, the child is in the process group of the shell
+        signal(SIGPIPE, SIG_DFL);
+        sigemptyset(&intmask);
+        sigaddset(&intmask, SIGINT);
+        sigprocmask(SIG_UNBLOCK, &intmask, NULL);
+        closefrom(3);
+        _exit(util_cat(argc - i + 1, files, NULL));  // Not the exit handlers of the shell
+    }
+    int status = waitchild(pid);
+    return WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+}
+
+int util_cat(int argc, char *args[], Cmdline *l) {
+    struct stat sout = {0}, sin;
+    int status = 0, i = 1;
+
+    fflush(stdout);  // Written directly into the fd, after the pending output of the shell
+    fstat(1, &sout);
+    if (i < argc && strcmp(args[i], "-u") == 0)
+        i++;  // The output is never buffered anyway
+    int shell = inshell();
+    if (i < argc && shell && !S_ISREG(sout.st_mode))
+        return forkcat(argc, args, i);  // A terminal, a device or a tube may block the write
+    for (int stdin_only = (i == argc); i < argc || stdin_only; i++, stdin_only = 0) {
+        char *name = stdin_only ? "-" : args[i];
+        // O_NONBLOCK : opening a FIFO without writer must not block the shell
+        int fd = (strcmp(name, "-") == 0) ? 0 : open(name, O_RDONLY | O_CLOEXEC | (shell ? O_NONBLOCK : 0));
+        if (fd < 0) {
+            fprintf(stderr, "%s: %s: %s\n", args[0], name, strerror(errno));
+            status = 1;
+            continue;
+        }
+
+        if (shell && fd != 0 && fstat(fd, &sin) == 0 && !S_ISREG(sin.st_mode) && !S_ISDIR(sin.st_mode)) {
+            // Decided on the opened file, which a rename cannot replace. The child opens it again, blocking
+            close(fd);
+            int fstatus = forkcat(argc, args, i);
+            return fstatus != 0 ? fstatus : status;
+        }
+        if (fstat(fd, &sin) == 0 && S_ISREG(sin.st_mode) && sin.st_dev == sout.st_dev && sin.st_ino == sout.st_ino &&
+            sin.st_size > 0) {
+            fprintf(stderr, "%s: %s: input file is output file\n", args[0], name);
+            status = 1;
+        } else if (transfer(fd, 1) < 0) {
+            if (errno == EPIPE) {  // Only when executed by the shell, which ignores SIGPIPE, like if cat was killed
+                if (fd != 0)
+                    close(fd);
+                return 128 + SIGPIPE;
+            }
+            fprintf(stderr, "%s: %s: %s\n", args[0], name, strerror(errno));
+            status = 1;
+        }
+        if (fd != 0)
+            close(fd);
+    }
+    return status;
+}
@@ -0,0 +1,44 @@
+#ifndef TP_SHELL_SR_2023_TRANSFER_H
+#define TP_SHELL_SR_2023_TRANSFER_H
+
+#include "readcmd.h"
+
+/* Tuning of the tubes, and builtins moving data to their standard output inside the kernel (copy_file_range(),
+ * sendfile(), splice(), tee()), so it never enters userspace. They fall back to read() and write() otherwise.
+ * When they read their standard input, they run as long as it is open, so they are executed by their own process,
+ * like external commands (see mustfork()).
+ */
+
+/* settubesize - Change the capacity of a tube
+ * Arguments :
+ *  - fd - One end of the tube
+ *  - size - The capacity in bytes, rounded up to a power of 2 pages by the kernel
+ * Return value : None
+ * Notes : The tube keeps its capacity if the kernel refuses (see /proc/sys/fs/pipe-max-size)
+ */
+void settubesize(int fd, long size);
+
+/* util_relay - Copy the standard input to the standard output, and to a file if one is given (like tee)
+ * Arguments :
+ *  - argc - The number of arguments
+ *  - args - The array of arguments, at most one file name
+ *  - l - The whole command line, unused
+ * Return value : The exit status, 0 on success, 1 if the file could not be opened or the data could not be moved
+ * Notes : The file is truncated. Without a file, one end must be a tube, and with one, both, to avoid the copy
+ */
+int util_relay(int argc, char *args[], Cmdline *l);
+
+/* util_cat - Copy files, or the standard input, to the standard output
+ * Arguments :
+ *  - argc - The number of arguments
+ *  - args - The array of arguments, the files to copy in order, "-" for the standard input, the standard input if
+ *           none is given, an initial "-u" is ignored (the output is never buffered)
+ *  - l - The whole command line, unused
+ * Return value : The exit status, 0 on success, 1 if a file could not be copied, 128 + SIGPIPE if the output was closed
+ * Notes : A file is not copied into itself. The other options of cat are not supported, the external cat is then
+ *         executed (see isinternal()). Executed by the shell, it forks if its output is not a regular file (see
+ *         forkcat())
+ */
+int util_cat(int argc, char *args[], Cmdline *l);
+
+#endif //TP_SHELL_SR_2023_TRANSFER_H
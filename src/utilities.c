@@ -0,0 +1,595 @@
+#include <stdio.h>
+#include <stdio_ext.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include "utilities.h"
+
+// State of the parser of the expression of test
+typedef struct _testparser {
+    char **args;  // The arguments of the expression
+    int pos;      // Index of the next argument to read
+    int end;      // Number of arguments of the expression
+    int error;    // 1 once a syntax error was printed
+    char *name;   // The name of the command, for the errors
+} TestParser;
+
+/* outstatus - Flush the output of a utility
+ * Arguments :
+ *  - name - The name of the utility, for the error message
+ * Return value : 0 if the output was written
+ *                128 + SIGPIPE if nobody reads it anymore, silently like if the utility was killed by SIGPIPE (the shell
+ *                ignores it)
+ *                1 otherwise (an error is printed)
+ * Notes : The output that could not be written is dropped, it must not reach the next standard output
+ */
+static int outstatus(char *name) {
+    if (fflush(stdout) == 0 && !ferror(stdout))
+        return 0;
+    int status = (errno == EPIPE) ? 128 + SIGPIPE : 1;
+    if (status == 1)
+        fprintf(stderr, "%s: write error: %s\n", name, strerror(errno));
+    __fpurge(stdout);
+    clearerr(stdout);
+    return status;
+}
+
+/* unescape - Decode the escape sequence following a backslash
+ * Arguments :
+ *  - s - The character following the backslash
+ *  - bstyle - 1 for the escapes of echo and "%b" (octal values may be written "\0nnn", "\c" stops the output),
+ *             0 for the escapes of a printf format (octal values are written "\nnn")
+ *  - c - Filled with the decoded character, -1 for "\c", the backslash itself for an unknown escape
+ * Return value : The character following the escape sequence (s itself for an unknown escape, which is then printed
+ *                as is)
+ */
+static char *unescape(char *s, int bstyle, int *c) {
+    char *escapes = "\\\\a\ab\bf\fn\nr\rt\tv\v";
+
+    for (char *e = escapes; *e != '\0'; e += 2) {
+        if (*s == e[0]) {
+            *c = (unsigned char) e[1];
+            return s + 1;
+        }
+    }
+    if (bstyle && *s == 'c') {
+        *c = -1;
+        return s + 1;
+    }
+    if ('0' <= *s && *s <= '7') {
+        if (bstyle && *s == '0')
+            s++;
+        *c = 0;
+        for (int n = 0; n < 3 && '0' <= *s && *s <= '7'; n++, s++)
+            *c = (*c * 8 + *s - '0') & 0xff;
+        return s;
+    }
+    *c = '\\';
+    return s;
+}
+
+/* putescaped - Print a string, interpreting its backslash escapes like echo
+ * Arguments :
+ *  - s - The string
+ * Return value : 1 if the output must stop ("\c" was found), 0 otherwise
+ */
+static int putescaped(char *s) {
+    int c;
+
+    // Most arguments have no escape at all
+    if (strchr(s, '\\') == NULL) {
+        fputs(s, stdout);
+        return 0;
+    }
+    while (*s != '\0') {
+        if (*s != '\\') {
+            putchar(*s++);
+            continue;
+        }
+        s = unescape(s + 1, 1, &c);
+        if (c == -1)
+            return 1;
+        putchar(c);
+    }
+    return 0;
+}
+
+int util_echo(int argc, char *args[], Cmdline *l) {
+    int i = 1, newline = 1;
+
+    if (argc > 1 && strcmp(args[1], "-n") == 0) {
+        newline = 0;
+        i++;
+    }
+    for (; i < argc; i++) {
+        if (putescaped(args[i]))
+            return outstatus(args[0]);
+        if (i + 1 < argc)
+            putchar(' ');
+    }
+    if (newline)
+        putchar('\n');
+    return outstatus(args[0]);
+}
+
+int util_true(int argc, char *args[], Cmdline *l) {
+    return 0;
+}
+
+int util_false(int argc, char *args[], Cmdline *l) {
+    return 1;
+}
+
+/* isunary - Tell whether an argument of test is a unary operator
+ * Arguments :
+ *  - op - The argument
+ * Return value : 1 if it is a unary operator, 0 otherwise
+ */
+static int isunary(char *op) {
+    return op[0] == '-' && op[1] != '\0' && op[2] == '\0' && strchr("bcdefghLnprSstuwxz", op[1]) != NULL;
+}
+
+/* isbinary - Tell whether an argument of test is a binary operator
+ * Arguments :
+ *  - op - The argument
+ * Return value : 1 if it is a binary operator, 0 otherwise
+ */
+static int isbinary(char *op) {
+    char *binaries[] = {"=", "!=", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt", "-ge", "-nt", "-ot", "-ef", NULL};
+
+    for (int i = 0; binaries[i] != NULL; i++)
+        if (strcmp(op, binaries[i]) == 0)
+            return 1;
+    return 0;
+}
+
+/* testerror - Print a syntax error of test, only the first one is printed
+ * Arguments :
+ *  - t - The parser
+ *  - arg - The argument involved, may be NULL
+ *  - msg - The error
+ * Return value : 0, the value of the erroneous expression
+ */
+static int testerror(TestParser *t, char *arg, char *msg) {
+    if (!t->error) {
+        if (arg != NULL)
+            fprintf(stderr, "%s: %s: %s\n", t->name, arg, msg);
+        else
+            fprintf(stderr, "%s: %s\n", t->name, msg);
+    }
+    t->error = 1;
+    return 0;
+}
+
+/* testint - Convert an operand of an integer comparison of test
+ * Arguments :
+ *  - t - The parser, its error is set if the operand is not an integer
+ *  - s - The operand
+ * Return value : The integer
+ */
+static long long testint(TestParser *t, char *s) {
+    char *end;
+
+    errno = 0;
+    long long n = strtoll(s, &end, 10);
+    if (end == s || *end != '\0' || errno != 0)
+        testerror(t, s, "bad number");
+    return n;
+}
+
+/* testunary - Evaluate a unary primary of test
+ * Arguments :
+ *  - op - The letter of the operator
+ *  - arg - The operand
+ * Return value : 1 if the primary is true, 0 otherwise
+ */
+static int testunary(char op, char *arg) {
+    struct stat st;
+
+    switch (op) {
+        case 'n':
+            return arg[0] != '\0';
+        case 'z':
+            return arg[0] == '\0';
+        case 't':
+            return isatty(atoi(arg));
+        case 'r':
+            return faccessat(AT_FDCWD, arg, R_OK, AT_EACCESS) == 0;
+        case 'w':
+            return faccessat(AT_FDCWD, arg, W_OK, AT_EACCESS) == 0;
+        case 'x':
+            return faccessat(AT_FDCWD, arg, X_OK, AT_EACCESS) == 0;
+        case 'h':
+        case 'L':
+            return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode);
+        default:
+            break;
+    }
+    if (stat(arg, &st) < 0)
+        return 0;
+    switch (op) {
+        case 'b':
+            return S_ISBLK(st.st_mode);
+        case 'c':
+            return S_ISCHR(st.st_mode);
+        case 'd':
+            return S_ISDIR(st.st_mode);
+        case 'f':
+            return S_ISREG(st.st_mode);
+        case 'g':
+            return (st.st_mode & S_ISGID) != 0;
+        case 'p':
+            return S_ISFIFO(st.st_mode);
+        case 'S':
+            return S_ISSOCK(st.st_mode);
+        case 's':
+            return st.st_size > 0;
+        case 'u':
+            return (st.st_mode & S_ISUID) != 0;
+        case 'e':
+        default:
+            return 1;
+    }
+}
+
+/* testbinary - Evaluate a binary primary of test
+ * Arguments :
+ *  - t - The parser, its error is set if an operand of an integer comparison is not an integer
+ *  - a - The left operand
+ *  - op - The operator
+ *  - b - The right operand
+ * Return value : 1 if the primary is true, 0 otherwise
+ */
+static int testbinary(TestParser *t, char *a, char *op, char *b) {
+    struct stat sa, sb;
+
+    if (strcmp(op, "=") == 0)
+        return strcmp(a, b) == 0;
+    if (strcmp(op, "!=") == 0)
+        return strcmp(a, b) != 0;
+    if (strcmp(op, "<") == 0)
+        return strcmp(a, b) < 0;
+    if (strcmp(op, ">") == 0)
+        return strcmp(a, b) > 0;
+
+    if (strcmp(op, "-nt") == 0 || strcmp(op, "-ot") == 0 || strcmp(op, "-ef") == 0) {
+        // File comparisons, a file that does not exist is older than any other
+        int ea = stat(a, &sa) == 0, eb = stat(b, &sb) == 0;
+        if (strcmp(op, "-ef") == 0)
+            return ea && eb && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+        if (strcmp(op, "-ot") == 0)
+            return eb && (!ea || sa.st_mtim.tv_sec < sb.st_mtim.tv_sec ||
+                          (sa.st_mtim.tv_sec == sb.st_mtim.tv_sec && sa.st_mtim.tv_nsec < sb.st_mtim.tv_nsec));
+        return ea && (!eb || sa.st_mtim.tv_sec > sb.st_mtim.tv_sec ||
+                      (sa.st_mtim.tv_sec == sb.st_mtim.tv_sec && sa.st_mtim.tv_nsec > sb.st_mtim.tv_nsec));
+    }
+
+    long long x = testint(t, a), y = testint(t, b);
+    if (strcmp(op, "-eq") == 0)
+        return x == y;
+    if (strcmp(op, "-ne") == 0)
+        return x != y;
+    if (strcmp(op, "-lt") == 0)
+        return x < y;
+    if (strcmp(op, "-le") == 0)
+        return x <= y;
+    if (strcmp(op, "-gt") == 0)
+        return x > y;
+    return x >= y;  // "-ge"
+}
+
+static int testor(TestParser *t);
+
+/* testprimary - Parse and evaluate a primary of test, or a parenthesized expression
+ * Arguments :
+ *  - t - The parser
+ * Return value : 1 if the primary is true, 0 otherwise
+ * Notes : A binary operator is looked for first, so "test -n = -n" compares two strings like in sh
+ */
+static int testprimary(TestParser *t) {
+    int left = t->end - t->pos;
+    char **a = t->args + t->pos;
+
+    if (left == 0)
+        return testerror(t, NULL, "argument expected");
+    if (left >= 3 && isbinary(a[1])) {
+        t->pos += 3;
+        return testbinary(t, a[0], a[1], a[2]);
+    }
+    if (left >= 2 && strcmp(a[0], "(") == 0) {
+        t->pos++;
+        int value = testor(t);
+        if (t->pos >= t->end || strcmp(t->args[t->pos], ")") != 0)
+            return testerror(t, NULL, "')' expected");
+        t->pos++;
+        return value;
+    }
+    if (left >= 2 && isunary(a[0])) {
+        t->pos += 2;
+        return testunary(a[0][1], a[1]);
+    }
+    t->pos++;
+    return a[0][0] != '\0';
+}
+
+/* testnot - Parse and evaluate a primary of test, negated by any number of "!"
+ * Arguments :
+ *  - t - The parser
+ * Return value : 1 if the expression is true, 0 otherwise
+ */
+static int testnot(TestParser *t) {
+    // A "!" alone is a non-empty string
+    if (t->end - t->pos >= 2 && strcmp(t->args[t->pos], "!") == 0) {
+        t->pos++;
+        return !testnot(t);
+    }
+    return testprimary(t);
+}
+
+/* testand - Parse and evaluate expressions of test joined by "-a"
+ * Arguments :
+ *  - t - The parser
+ * Return value : 1 if the expression is true, 0 otherwise
+ */
+static int testand(TestParser *t) {
+    int value = testnot(t);
+    while (t->pos < t->end && strcmp(t->args[t->pos], "-a") == 0) {
+        t->pos++;
+        value = testnot(t) && value;  // Always parsed, to find the syntax errors
+    }
+    return value;
+}
+
+/* testor - Parse and evaluate expressions of test joined by "-o", "-a" binding tighter
+ * Arguments :
+ *  - t - The parser
+ * Return value : 1 if the expression is true, 0 otherwise
+ */
+static int testor(TestParser *t) {
+    int value = testand(t);
+    while (t->pos < t->end && strcmp(t->args[t->pos], "-o") == 0) {
+        t->pos++;
+        value = testand(t) || value;
+    }
+    return value;
+}
+
+int util_test(int argc, char *args[], Cmdline *l) {
+    TestParser t = {args + 1, 0, argc - 1, 0, args[0]};
+
+    if (strcmp(args[0], "[") == 0) {
+        if (strcmp(args[argc - 1], "]") != 0) {
+            fprintf(stderr, "%s: missing ]\n", args[0]);
+            return 2;
+        }
+        t.end--;
+    }
+    if (t.end == 0)
+        return 1;
+
+    int value = testor(&t);
+    if (t.pos < t.end)
+        testerror(&t, t.args[t.pos], "unexpected operator");
+    return t.error ? 2 : !value;
+}
+
+/* nextvalue - Get the next value of printf
+ * Arguments :
+ *  - values - The next value, it is moved past the returned value
+ *  - end - The end of the values
+ * Return value : The value, NULL if there is none left
+ */
+static char *nextvalue(char ***values, char **end) {
+    return (*values < end) ? *(*values)++ : NULL;
+}
+
+/* getnumber - Convert a value of a numeric conversion of printf
+ * Arguments :
+ *  - s - The value, NULL if missing (it is then 0)
+ *  - status - Set to 1 if the value is not a valid number, an error is printed
+ * Return value : The number, the code of its second character if the value starts with a quote (like "'A")
+ */
+static long long getnumber(char *s, int *status) {
+    char *end;
+
+    if (s == NULL)
+        return 0;
+    if (s[0] == '\'' || s[0] == '"')
+        return (unsigned char) s[1];
+    errno = 0;
+    long long n = (*s == '-') ? strtoll(s, &end, 0) : (long long) strtoull(s, &end, 0);
+    if (end == s || *end != '\0' || errno != 0) {
+        fprintf(stderr, "printf: %s: invalid number\n", s);
+        *status = 1;
+    }
+    return n;
+}
+
+/* getdouble - Convert a value of a floating point conversion of printf
+ * Arguments : Same as getnumber()
+ * Return value : The number
+ */
+static double getdouble(char *s, int *status) {
+    char *end;
+
+    if (s == NULL)
+        return 0;
+    if (s[0] == '\'' || s[0] == '"')
+        return (unsigned char) s[1];
+    errno = 0;
+    double d = strtod(s, &end);
+    if (end == s || *end != '\0' || errno != 0) {
+        fprintf(stderr, "printf: %s: invalid number\n", s);
+        *status = 1;
+    }
+    return d;
+}
+
+/* printformat - Print the format of printf once
+ * Arguments :
+ *  - format - The format
+ *  - values - The next value, it is moved past the values consumed by the conversions
+ *  - end - The end of the values
+ *  - status - Set to 1 on an error
+ * Return value : 1 if the output must stop ("\c" in a "%b" value, or an invalid conversion), 0 otherwise
+ */
+static int printformat(char *format, char ***values, char **end, int *status) {
+    for (char *s = format; *s != '\0'; s++) {
+        if (*s == '\\') {
+            int c;
+            s = unescape(s + 1, 0, &c) - 1;
+            putchar(c);
+            continue;
+        }
+        if (*s != '%') {
+            putchar(*s);
+            continue;
+        }
+        if (s[1] == '%') {
+            putchar('%');
+            s++;
+            continue;
+        }
+
+        // Copy the flags, the width and the precision of the conversion, the "*" are given as arguments of printf()
+        char spec[32] = "%";
+        size_t n = 1;
+        int stars[2], nb_stars = 0;
+        char *p = s + 1;
+        for (; *p != '\0' && strchr("-+ #0", *p) != NULL; p++)
+            if (n < 7)
+                spec[n++] = *p;
+        for (int part = 0; part < 2; part++) {
+            if (part == 1) {
+                if (*p != '.')
+                    break;
+                spec[n++] = *p++;
+            }
+            if (*p == '*') {
+                spec[n++] = *p++;
+                stars[nb_stars++] = (int) getnumber(nextvalue(values, end), status);
+            } else
+                for (int digits = 0; '0' <= *p && *p <= '9'; p++)
+                    if (digits++ < 9)
+                        spec[n++] = *p;
+        }
+
+        char *value, buf[2] = "";
+        switch (*p) {
+            case 'd':
+            case 'i':
+            case 'o':
+            case 'u':
+            case 'x':
+            case 'X': {
+                long long number = getnumber(nextvalue(values, end), status);
+                spec[n++] = 'l';
+                spec[n++] = 'l';
+                spec[n++] = *p;
+                spec[n] = '\0';
+                if (nb_stars == 2)
+                    printf(spec, stars[0], stars[1], number);
+                else if (nb_stars == 1)
+                    printf(spec, stars[0], number);
+                else
+                    printf(spec, number);
+                break;
+            }
+            case 'a':
+            case 'A':
+            case 'e':
+            case 'E':
+            case 'f':
+            case 'F':
+            case 'g':
+            case 'G': {
+                double number = getdouble(nextvalue(values, end), status);
+                spec[n++] = *p;
+                spec[n] = '\0';
+                if (nb_stars == 2)
+                    printf(spec, stars[0], stars[1], number);
+                else if (nb_stars == 1)
+                    printf(spec, stars[0], number);
+                else
+                    printf(spec, number);
+                break;
+            }
+            case 'b':
+                value = nextvalue(values, end);
+                if (nb_stars == 0 && n == 1) {
+                    if (value != NULL && putescaped(value))
+                        return 1;
+                    break;
+                }
+                // Padded, the escapes are decoded first (the result is never longer)
+                char *decoded = malloc((value != NULL ? strlen(value) : 0) + 1), *d = decoded;
+                int stop = 0;
+                for (char *v = value; v != NULL && *v != '\0' && !stop;) {
+                    int c = (unsigned char) *v;
+                    v = (*v == '\\') ? unescape(v + 1, 1, &c) : v + 1;
+                    if (!(stop = (c == -1)))
+                        *d++ = (char) c;
+                }
+                *d = '\0';
+                spec[n++] = 's';
+                spec[n] = '\0';
+                if (nb_stars == 2)
+                    printf(spec, stars[0], stars[1], decoded);
+                else if (nb_stars == 1)
+                    printf(spec, stars[0], decoded);
+                else
+                    printf(spec, decoded);
+                free(decoded);
+                if (stop)
+                    return 1;
+                break;
+            case 'c':
+            case 's':
+                if ((value = nextvalue(values, end)) == NULL)
+                    value = "";
+                if (*p == 'c') {
+                    buf[0] = value[0];
+                    value = buf;
+                }
+                spec[n++] = 's';
+                spec[n] = '\0';
+                if (nb_stars == 2)
+                    printf(spec, stars[0], stars[1], value);
+                else if (nb_stars == 1)
+                    printf(spec, stars[0], value);
+                else
+                    printf(spec, value);
+                break;
+            default:
+                fprintf(stderr, "printf: %%%c: invalid directive\n", *p);
+                *status = 1;
+                return 1;
+        }
+        s = p;
+    }
+    return 0;
+}
+
+int util_printf(int argc, char *args[], Cmdline *l) {
+    int status = 0;
+
+    if (argc < 2) {
+        fprintf(stderr, "%s: usage: %s format [arg ...]\n", args[0], args[0]);
+        return 2;
+    }
+
+    // The format is used again for the values left, unless it consumed none of them
+    char **values = args + 2, **end = args + argc, **before;
+    do {
+        before = values;
+        if (printformat(args[1], &values, end, &status))
+            break;
+    } while (values < end && values != before);
+
+    int out = outstatus(args[0]);
+    return out ? out : status;
+}
@@ -0,0 +1,56 @@
+#ifndef TP_SHELL_SR_2023_UTILITIES_H
+#define TP_SHELL_SR_2023_UTILITIES_H
+
+#include "readcmd.h"
+
+/* POSIX utilities executed by the shell itself instead of being forked and executed from $PATH, like the builtins of
+ * sh. They write into the stdio buffer of the standard output, which they flush once before returning, and
+ * they never read their standard input. They have the signature of every builtin (see check_internal_commands()).
+ * Their behavior follows the one of the builtins of /bin/sh (dash), an explicit path (e.g. "/bin/echo") still
+ * executes the external utility.
+ */
+
+/* util_echo - Print the arguments separated by spaces, followed by a newline
+ * Arguments :
+ *  - argc - The number of arguments
+ *  - args - The array of arguments
+ *  - l - The whole command line, unused
+ * Return value : The exit status, 0 on success, 1 if the output could not be written
+ * Notes : A first argument "-n" suppresses the newline, backslash escapes are interpreted ("\c" stops the output)
+ */
+int util_echo(int argc, char *args[], Cmdline *l);
+
+/* util_true - Do nothing, successfully
+ * Arguments : Ignored
+ * Return value : 0
+ */
+int util_true(int argc, char *args[], Cmdline *l);
+
+/* util_false - Do nothing, unsuccessfully
+ * Arguments : Ignored
+ * Return value : 1
+ */
+int util_false(int argc, char *args[], Cmdline *l);
+
+/* util_test - Evaluate a conditional expression (also called as "[", the last argument must then be "]")
+ * Arguments :
+ *  - argc - The number of arguments
+ *  - args - The array of arguments
+ *  - l - The whole command line, unused
+ * Return value : 0 if the expression is true, 1 if it is false, 2 on a syntax error (printed in standard error)
+ * Notes : Supports the unary file and string primaries, the string and integer comparisons, "-nt", "-ot", "-ef",
+ *         "!", "-a", "-o" and parentheses
+ */
+int util_test(int argc, char *args[], Cmdline *l);
+
+/* util_printf - Print the arguments according to a format
+ * Arguments :
+ *  - argc - The number of arguments
+ *  - args - The array of arguments, the format and then the values of its conversions
+ *  - l - The whole command line, unused
+ * Return value : The exit status, 0 on success, 1 if a value was not a valid number, 2 if no format is given
+ * Notes : The format is reused as long as values remain, missing values are empty strings or zeros
+ */
+int util_printf(int argc, char *args[], Cmdline *l);
+
+#endif //TP_SHELL_SR_2023_UTILITIES_H
@@ -6,11 +6,16 @@ GREEN='\033[0;32m'
 NOCOLOR='\033[0m'
 
 
-# On compare le resultat des commandes entre notre shell et sh
+# On compare le resultat des commandes et le code de retour du shell entre notre shell et sh
+# Si sh ne connait pas ce qui est teste, le resultat attendu est dans un fichier .expected a cote du test
 for test in tests/*.txt
 do
-    ./sdriver.pl -t $test -s /bin/sh | sort > tests/default
-    ./sdriver.pl -t $test -s ./shell | sort > tests/output
+    if [ -f ${test%.txt}.expected ]; then
+        sort ${test%.txt}.expected > tests/default
+    else
+        ./sdriver.pl -x -t $test -s /bin/sh | sort > tests/default
+    fi
+    ./sdriver.pl -x -t $test -s ./shell | sort > tests/output
     if diff tests/default tests/output > tests/tmp;
     then
         echo -e ${GREEN}passed $test ${NOCOLOR}